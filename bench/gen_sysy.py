@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+"""生成用于压测的 SysY 程序.
+
+生成的程序只使用编译器目前支持的语法: 一个 int main(), 若干 const 定义和 return 语句.
+常量初始化表达式只除以非零的字面量, 并且对结果取模, 保证编译期求值不会除零或溢出.
+
+    bench/gen_sysy.py --consts 1000 --depth 6 --width 3 --comments 20 -o big.c
+"""
+
+import argparse
+import random
+import sys
+
+BINARY_OPS = ['+', '-', '*', '/', '%', '<', '>', '<=', '>=', '==', '!=', '&&', '||']
+UNARY_OPS = ['+', '-', '!']
+
+
+class Generator:
+    def __init__(self, args):
+        self.args = args
+        self.rng = random.Random(args.seed)
+        self.consts = []
+
+    def leaf(self):
+        if self.consts and self.rng.random() < 0.5:
+            return self.rng.choice(self.consts)
+        return str(self.rng.randint(0, 100))
+
+    def exp(self, depth):
+        """深度为 depth 的表达式, 每层把 width 个子表达式用二元运算符连起来."""
+        if depth <= 0:
+            ret = self.leaf()
+            if self.rng.random() < 0.2:
+                ret = self.rng.choice(UNARY_OPS) + ret
+            return ret
+        parts = []
+        for i in range(self.args.width):
+            # right-heavy: 只有最后一个子表达式继续向下展开, 其余都是叶子
+            # 这样左边的结果在整个右子树求值期间都要占着寄存器
+            if self.args.shape == 'right' and i + 1 < self.args.width:
+                parts.append(self.leaf())
+            elif self.args.shape == 'left' and i > 0:
+                parts.append(self.leaf())
+            else:
+                parts.append(self.exp(depth - 1))
+        ret = parts[0]
+        for part in parts[1:]:
+            op = self.rng.choice(BINARY_OPS)
+            if op in ('/', '%'):
+                # 运行时的除法也只除以非零字面量
+                ret = '%s %s %d' % (ret, op, self.rng.randint(1, 9))
+                ret = '(%s) + %s' % (ret, part)
+            else:
+                ret = '%s %s %s' % (ret, op, part)
+        return '(%s)' % ret
+
+    def const_exp(self):
+        """常量初始化表达式, 值始终落在 (-997, 997) 之内."""
+        terms = [self.leaf() for _ in range(self.rng.randint(1, 3))]
+        ret = terms[0]
+        for term in terms[1:]:
+            ret = '%s %s %s' % (ret, self.rng.choice(['+', '-']), term)
+        return '((%s) * %d + %d) %% 997' % (ret, self.rng.randint(1, 9), self.rng.randint(0, 99))
+
+    def comment(self):
+        words = ['lorem', 'ipsum', 'dolor', 'sit', 'amet', '*', '/', 'return', 'int', '42']
+        lines = [' '.join(self.rng.choice(words) for _ in range(12))
+                 for _ in range(self.args.comment_lines)]
+        return '  /* ' + '\n   * '.join(lines) + '\n   */\n'
+
+    def program(self):
+        out = ['int main() {\n']
+        comment_every = max(1, self.args.consts // max(1, self.args.comments))
+        comments = 0
+        for i in range(self.args.consts):
+            if comments < self.args.comments and i % comment_every == 0:
+                out.append(self.comment())
+                comments += 1
+            name = 'c%d' % i
+            out.append('  const int %s = %s;  // %s\n' % (name, self.const_exp(), name))
+            self.consts.append(name)
+        while comments < self.args.comments:
+            out.append(self.comment())
+            comments += 1
+        for _ in range(self.args.returns):
+            out.append('  return %s;\n' % self.exp(self.args.depth))
+        out.append('}\n')
+        return ''.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--consts', type=int, default=100, help='const 定义的数量 N')
+    parser.add_argument('--depth', type=int, default=4, help='return 表达式的深度 D')
+    parser.add_argument('--width', type=int, default=2, help='每层表达式的宽度 W')
+    parser.add_argument('--shape', choices=['full', 'left', 'right'], default='full',
+                        help='表达式树的形状')
+    parser.add_argument('--returns', type=int, default=1, help='return 语句的数量')
+    parser.add_argument('--comments', type=int, default=0, help='块注释的数量')
+    parser.add_argument('--comment-lines', type=int, default=8, help='每个块注释的行数')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('-o', '--output', help='输出文件, 默认写到 stdout')
+    args = parser.parse_args()
+
+    text = Generator(args).program()
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""编译器吞吐量基准测试.
+
+生成一组参数化的 SysY 程序, 用 -koopa 和 -riscv 两种模式分别编译,
+报告每秒处理的行数和 token 数, 以及 -riscv 模式生成的指令条数, 并与保存的 baseline 对比.
+
+    bench/run_bench.py --compiler build/compiler --corpus build/bench
+    bench/run_bench.py ... --update-baseline   # 把本次结果保存为新的 baseline
+    bench/run_bench.py ... --flags=-O1         # 给编译器传额外的选项
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import gen_sysy  # noqa: E402
+
+# 语料: 名字 -> gen_sysy 的参数
+CORPUS = {
+    'consts':   dict(consts=5000, depth=2, width=2, shape='full', returns=1, comments=0),
+    'wide':     dict(consts=50, depth=3, width=12, shape='full', returns=20, comments=0),
+    'deep':     dict(consts=50, depth=10, width=2, shape='full', returns=4, comments=0),
+    'right':    dict(consts=50, depth=200, width=2, shape='right', returns=20, comments=0),
+    'left':     dict(consts=50, depth=200, width=2, shape='left', returns=20, comments=0),
+    'comments': dict(consts=500, depth=2, width=2, shape='full', returns=1, comments=500),
+}
+MODES = ['-koopa', '-riscv']
+
+TOKEN_RE = re.compile(r'[A-Za-z_][A-Za-z0-9_]*|0[xX][0-9a-fA-F]+|\d+|<=|>=|==|!=|&&|\|\||\S')
+COMMENT_RE = re.compile(r'//[^\n]*|/\*.*?\*/', re.S)
+# 汇编中的指令行: 去掉空行, 标号和伪指令
+INST_RE = re.compile(r'^\s+[a-z]', re.M)
+
+
+def generate(corpus_dir):
+    os.makedirs(corpus_dir, exist_ok=True)
+    files = {}
+    for name, params in CORPUS.items():
+        path = os.path.join(corpus_dir, name + '.c')
+        args = argparse.Namespace(seed=1, comment_lines=8, **params)
+        text = gen_sysy.Generator(args).program()
+        with open(path, 'w') as f:
+            f.write(text)
+        lines = text.count('\n')
+        tokens = len(TOKEN_RE.findall(COMMENT_RE.sub(' ', text)))
+        files[name] = (path, lines, tokens)
+    return files
+
+
+def count_insts(path):
+    with open(path) as f:
+        return len(INST_RE.findall(f.read()))
+
+
+def run_once(compiler, mode, path, output, flags):
+    start = time.perf_counter()
+    proc = subprocess.run([compiler, mode, path, '-o', output] + flags,
+                          stdout=subprocess.DEVNULL, stderr=subprocess.PIPE)
+    elapsed = time.perf_counter() - start
+    if proc.returncode != 0:
+        return None
+    return elapsed
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--compiler', default='build/compiler')
+    parser.add_argument('--corpus', default='build/bench', help='生成语料的目录')
+    parser.add_argument('--baseline', default=os.path.join(os.path.dirname(__file__),
+                                                           'baseline.json'))
+    parser.add_argument('--repeat', type=int, default=5, help='每个用例重复次数, 取最快的一次')
+    parser.add_argument('--threshold', type=float, default=0.10,
+                        help='比 baseline 慢超过该比例时标记为回退')
+    parser.add_argument('--flags', default='', help='传给编译器的额外选项, 以空格分隔')
+    parser.add_argument('--update-baseline', action='store_true')
+    args = parser.parse_args()
+    flags = args.flags.split()
+
+    # 吞吐量只有和同一台机器上的结果比较才有意义, 所以仓库中没有提交 baseline
+    baseline = {}
+    if os.path.exists(args.baseline):
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+    elif not args.update_baseline:
+        print('error: no baseline at %s; record one on this machine first with '
+              '`make bench-baseline` (or run with --update-baseline)' % args.baseline,
+              file=sys.stderr)
+        return 2
+    files = generate(args.corpus)
+
+    results = {}
+    regressions = 0
+    failures = 0
+    print('%-10s %-7s %8s %9s %12s %13s %8s %9s' % ('corpus', 'mode', 'lines', 'time(ms)',
+                                                     'lines/sec', 'tokens/sec', 'insts',
+                                                     'vs base'))
+    for name, (path, lines, tokens) in files.items():
+        for mode in MODES:
+            output = os.path.join(args.corpus, '%s.%s.out' % (name, mode[1:]))
+            times = [run_once(args.compiler, mode, path, output, flags) for _ in range(args.repeat)]
+            if None in times:
+                print('%-10s %-7s %8d %9s' % (name, mode, lines, 'FAILED'))
+                failures += 1
+                continue
+            best = min(times)
+            key = '%s%s' % (name, mode)
+            insts = count_insts(output) if mode == '-riscv' else None
+            results[key] = {'lines': lines, 'tokens': tokens, 'seconds': best,
+                            'lines_per_sec': lines / best, 'tokens_per_sec': tokens / best}
+            if insts is not None:
+                results[key]['insts'] = insts
+            compare = '-'
+            if key in baseline:
+                ratio = results[key]['tokens_per_sec'] / baseline[key]['tokens_per_sec']
+                compare = '%.2fx' % ratio
+                if ratio < 1 - args.threshold:
+                    compare += ' REGRESSION'
+                    regressions += 1
+            print('%-10s %-7s %8d %9.2f %12.0f %13.0f %8s %9s' % (
+                name, mode, lines, best * 1000, lines / best, tokens / best,
+                '-' if insts is None else insts, compare))
+
+    if args.update_baseline:
+        with open(args.baseline, 'w') as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+            f.write('\n')
+        print('baseline written to %s' % args.baseline)
+    return 1 if regressions or failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""用编译器内置的模拟器 (-sim) 运行示例程序和 benchmark 语料.
+
+对每个程序报告 main 的返回值, 动态指令数, 按延迟模型估算的周期数和 CPI,
+用来比较代码生成改动前后的效果, 不需要 RISC-V 硬件.
+
+    bench/run_sim.py --compiler build/compiler --corpus build/bench hello.c add.c
+    bench/run_sim.py ... --flags=-O1            # 给编译器传额外的选项
+    bench/run_sim.py ... --flags=-sim-model=u74 # 换一个延迟模型
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+import run_bench  # noqa: E402
+
+
+def simulate(compiler, path, output, flags):
+    proc = subprocess.run([compiler, '-sim', path, '-o', output] + flags,
+                          stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+    if proc.returncode != 0:
+        return None, proc.stderr.strip()
+    result = {}
+    with open(output) as f:
+        for line in f:
+            key, value = line.split(':')
+            result[key.strip()] = int(value)
+    return result, None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--compiler', default='build/compiler')
+    parser.add_argument('--corpus', default='build/bench', help='生成语料的目录')
+    parser.add_argument('--flags', default='', help='传给编译器的额外选项, 以空格分隔')
+    parser.add_argument('inputs', nargs='*', help='额外运行的 SysY 程序, 例如仓库中的示例')
+    args = parser.parse_args()
+    flags = args.flags.split()
+
+    programs = [(os.path.basename(path), path) for path in args.inputs]
+    programs += [(name + '.c', path) for name, (path, _, _) in run_bench.generate(args.corpus).items()]
+
+    failures = 0
+    total_insts = total_cycles = 0
+    print('%-14s %12s %12s %12s %6s' % ('program', 'exit', 'insts', 'cycles', 'CPI'))
+    for name, path in programs:
+        output = os.path.join(args.corpus, name + '.sim')
+        result, error = simulate(args.compiler, path, output, flags)
+        if result is None:
+            print('%-14s %12s  %s' % (name, 'FAILED', error))
+            failures += 1
+            continue
+        insts, cycles = result['instructions'], result['cycles']
+        total_insts += insts
+        total_cycles += cycles
+        print('%-14s %12d %12d %12d %6.2f' % (name, result['exit'], insts, cycles,
+                                               cycles / insts if insts else 0))
+    print('%-14s %12s %12d %12d %6.2f' % ('total', '', total_insts, total_cycles,
+                                           total_cycles / total_insts if total_insts else 0))
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
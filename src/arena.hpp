@@ -0,0 +1,115 @@
+#ifndef __ARENA_HPP__
+#define __ARENA_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <utility>
+#include <vector>
+
+// bump allocator, 一次编译中的 AST 节点和 parser 临时数据都从这里分配
+// 所有内存在 Arena 析构时一次性释放, 不会调用对象的析构函数
+// 所以放进 Arena 的对象不能持有需要析构的资源 (std::string, unique_ptr 等)
+// Reset 丢弃所有对象但保留已申请的块, 长期运行的进程 (-serve) 可以反复使用同一个 Arena
+class Arena {
+ public:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  Arena() = default;
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+  ~Arena() {
+    for (char *chunk : chunks_) ::operator delete(chunk);
+    for (char *chunk : large_chunks_) ::operator delete(chunk);
+  }
+
+  void* Allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+    uintptr_t p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+    if (cur_ == nullptr || p + size > reinterpret_cast<uintptr_t>(end_)) {
+      NewChunk(size + align);
+      p = (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(uintptr_t)(align - 1);
+    }
+    cur_ = reinterpret_cast<char*>(p + size);
+    return reinterpret_cast<void*>(p);
+  }
+
+  template <typename T, typename... Args>
+  T* New(Args&&... args) {
+    return new (Allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  // 拷贝一份以 '\0' 结尾的字符串
+  const char* CopyString(const char *str, size_t len) {
+    char *ret = static_cast<char*>(Allocate(len + 1, 1));
+    memcpy(ret, str, len);
+    ret[len] = '\0';
+    return ret;
+  }
+
+  // 释放 Arena 中的所有对象, 之后的分配从头复用标准大小的块
+  // 超过 kChunkSize 的大块很少出现, 直接归还给系统
+  void Reset() {
+    for (char *chunk : large_chunks_) ::operator delete(chunk);
+    large_chunks_.clear();
+    next_chunk_ = 0;
+    cur_ = nullptr;
+    end_ = nullptr;
+  }
+
+ private:
+  void NewChunk(size_t min_size) {
+    char *chunk;
+    size_t size = kChunkSize;
+    if (min_size > kChunkSize) {
+      size = min_size;
+      chunk = static_cast<char*>(::operator new(size));
+      large_chunks_.push_back(chunk);
+    } else if (next_chunk_ < chunks_.size()) {
+      chunk = chunks_[next_chunk_ ++];
+    } else {
+      chunk = static_cast<char*>(::operator new(size));
+      chunks_.push_back(chunk);
+      next_chunk_ = chunks_.size();
+    }
+    cur_ = chunk;
+    end_ = chunk + size;
+  }
+
+  // 标准大小的块, [0, next_chunk_) 已经被使用
+  std::vector<char*> chunks_;
+  size_t next_chunk_ = 0;
+  std::vector<char*> large_chunks_;
+  char *cur_ = nullptr;
+  char *end_ = nullptr;
+};
+
+// 让标准容器从 Arena 中分配内存, deallocate 什么都不做
+template <typename T>
+class ArenaAllocator {
+ public:
+  using value_type = T;
+
+  explicit ArenaAllocator(Arena &arena) : arena_(&arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) : arena_(other.arena_) {}
+
+  T* allocate(size_t n) {
+    return static_cast<T*>(arena_->Allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T*, size_t) {}
+
+  template <typename U>
+  bool operator==(const ArenaAllocator<U> &other) const { return arena_ == other.arena_; }
+  template <typename U>
+  bool operator!=(const ArenaAllocator<U> &other) const { return arena_ != other.arena_; }
+
+ private:
+  template <typename U> friend class ArenaAllocator;
+  Arena *arena_;
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif
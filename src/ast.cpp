@@ -1,4 +1,194 @@
+#include <algorithm>
+#include <cassert>
+#include <string>
 #include "ast.hpp"
+#include "opt.hpp"
 
-int BaseAST::cur_tmp_reg_id = -1;
-std::unordered_map<std::string, int> BaseAST::symbol_table;
\ No newline at end of file
+// ExprOp 对应的 Koopa 二元运算, LAND/LOR 单独处理
+static koopa_raw_binary_op_t KoopaOp(ExprOp op) {
+  switch (op) {
+    case ExprOp::ADD: return KOOPA_RBO_ADD;
+    case ExprOp::SUB: return KOOPA_RBO_SUB;
+    case ExprOp::MUL: return KOOPA_RBO_MUL;
+    case ExprOp::DIV: return KOOPA_RBO_DIV;
+    case ExprOp::MOD: return KOOPA_RBO_MOD;
+    case ExprOp::LT: return KOOPA_RBO_LT;
+    case ExprOp::GT: return KOOPA_RBO_GT;
+    case ExprOp::LE: return KOOPA_RBO_LE;
+    case ExprOp::GE: return KOOPA_RBO_GE;
+    case ExprOp::EQ: return KOOPA_RBO_EQ;
+    case ExprOp::NE: return KOOPA_RBO_NOT_EQ;
+    default:
+      assert(false);
+  }
+  return KOOPA_RBO_ADD;
+}
+
+static bool DoFold(BuildContext &ctx, const ExprNode &node, int32_t &value) {
+  switch (node.kind) {
+    case ExprKind::NUMBER:
+      value = node.number;
+      return true;
+    case ExprKind::LVAL: {
+      const Symbol *symbol = ctx.symbols.Lookup(node.symbol);
+      if (symbol == nullptr) {
+        throw std::string("undefined symbol: ") + ctx.interner.Name(node.symbol);
+      }
+      if (symbol->kind != Symbol::SymbolKind::CONST) return false;
+      value = symbol->value;
+      return true;
+    }
+    case ExprKind::UNARY: {
+      int32_t operand;
+      if (!FoldExpr(ctx, node.lhs, operand)) return false;
+      if (node.op == ExprOp::NEG) return EvalBinary(KOOPA_RBO_SUB, 0, operand, value);
+      value = !operand;
+      return true;
+    }
+    case ExprKind::BINARY: {
+      int32_t lhs, rhs;
+      bool lhs_const = FoldExpr(ctx, node.lhs, lhs);
+      bool rhs_const = FoldExpr(ctx, node.rhs, rhs);
+      if (node.op == ExprOp::LOR || node.op == ExprOp::LAND) {
+        // || 左边是非 0 常量, && 左边是常量 0 时结果已经确定
+        bool is_or = node.op == ExprOp::LOR;
+        if (lhs_const && (lhs != 0) == is_or) {
+          value = is_or;
+          return true;
+        }
+        value = rhs != 0;
+        return lhs_const && rhs_const;
+      }
+      return lhs_const && rhs_const && EvalBinary(KoopaOp(node.op), lhs, rhs, value);
+    }
+  }
+  return false;
+}
+
+bool FoldExpr(BuildContext &ctx, ExprId id, int32_t &value) {
+  // 解析结束后不再创建节点, 引用在整个 Build 过程中有效
+  ExprNode &node = ctx.exprs[id];
+  if (node.fold_state == FoldState::UNKNOWN) {
+    int32_t result = 0;
+    bool is_const = DoFold(ctx, node, result);
+    node.fold_state = is_const ? FoldState::CONST : FoldState::NOT_CONST;
+    node.fold_value = result;
+  }
+  value = node.fold_value;
+  return node.fold_state == FoldState::CONST;
+}
+
+static int DoRegisterNeed(BuildContext &ctx, const ExprNode &node) {
+  switch (node.kind) {
+    case ExprKind::NUMBER:
+    case ExprKind::LVAL:
+      // 非常量的变量需要一个寄存器存放读出的值
+      return 1;
+    case ExprKind::UNARY:
+      // 结果可以直接覆盖操作数
+      return std::max(RegisterNeed(ctx, node.lhs), 1);
+    case ExprKind::BINARY: {
+      int lhs = RegisterNeed(ctx, node.lhs);
+      int rhs = RegisterNeed(ctx, node.rhs);
+      // 短路求值的两边在不同的基本块中依次计算, 结果经过内存, 两边不会同时活跃
+      if (node.op == ExprOp::LOR || node.op == ExprOp::LAND) return std::max({lhs, rhs, 1});
+      // 先算需求大的一边, 它的结果只在算另一边时多占一个寄存器; 两边相同时多需要一个
+      return lhs == rhs ? lhs + 1 : std::max(lhs, rhs);
+    }
+  }
+  return 1;
+}
+
+// 生成 IR 时表达式是否直接用立即数代替
+static bool IsImmediate(BuildContext &ctx, ExprId id, int32_t &value) {
+  if (!FoldExpr(ctx, id, value)) return false;
+  const ExprNode &node = ctx.exprs[id];
+  return ctx.fold || node.kind == ExprKind::NUMBER || node.kind == ExprKind::LVAL;
+}
+
+int RegisterNeed(BuildContext &ctx, ExprId id) {
+  int32_t folded;
+  if (IsImmediate(ctx, id, folded)) return 0;
+  ExprNode &node = ctx.exprs[id];
+  if (node.reg_need == 0) {
+    // 超过 255 的需求已经远大于寄存器数, 按 255 处理不影响求值顺序的选择
+    node.reg_need = std::min(DoRegisterNeed(ctx, node), 255);
+  }
+  return node.reg_need;
+}
+
+// 短路求值:
+//   result = alloc i32
+//   store short_value, result
+//   br left, ...          (|| 为真 / && 为假时直接跳到 end)
+// %rhs:
+//   store (right != 0), result
+//   jump %end
+// %end:
+//   load result
+static koopa_raw_value_t BuildShortCircuit(BuildContext &ctx, ExprId left, ExprId right,
+                                           int32_t short_value, const std::string &prefix) {
+  KoopaBuilder &builder = ctx.builder;
+  koopa_raw_value_t result = builder.NewAlloc(KoopaBuilder::Int32Type());
+  koopa_raw_value_t lhs = BuildExpr(ctx, left);
+  builder.NewStore(builder.NewInteger(short_value), result);
+  koopa_raw_basic_block_data_t *rhs_bb = builder.NewBasicBlock(prefix + "_rhs");
+  koopa_raw_basic_block_data_t *end_bb = builder.CreateBasicBlock(prefix + "_end");
+  if (short_value) {
+    builder.NewBranch(lhs, end_bb, rhs_bb);
+  } else {
+    builder.NewBranch(lhs, rhs_bb, end_bb);
+  }
+  builder.SetInsertPoint(rhs_bb);
+  koopa_raw_value_t rhs = BuildExpr(ctx, right);
+  koopa_raw_value_t value = builder.NewBinary(KOOPA_RBO_NOT_EQ, rhs, builder.NewInteger(0));
+  builder.NewStore(value, result);
+  builder.NewJump(end_bb);
+  // right 中可能生成了新的基本块, end 放在它们之后
+  builder.InsertBlock(end_bb);
+  builder.SetInsertPoint(end_bb);
+  return builder.NewLoad(result);
+}
+
+koopa_raw_value_t BuildExpr(BuildContext &ctx, ExprId id) {
+  KoopaBuilder &builder = ctx.builder;
+  // 整个表达式是常量时直接生成一个立即数
+  int32_t folded;
+  if (IsImmediate(ctx, id, folded)) return builder.NewInteger(folded);
+
+  const ExprNode &node = ctx.exprs[id];
+  switch (node.kind) {
+    case ExprKind::NUMBER:
+    case ExprKind::LVAL:
+      // 目前只有常量, 一定已经被折叠
+      assert(false);
+      return nullptr;
+    case ExprKind::UNARY: {
+      koopa_raw_value_t operand = BuildExpr(ctx, node.lhs);
+      if (node.op == ExprOp::NEG) {
+        return builder.NewBinary(KOOPA_RBO_SUB, builder.NewInteger(0), operand);
+      }
+      return builder.NewBinary(KOOPA_RBO_EQ, operand, builder.NewInteger(0));
+    }
+    case ExprKind::BINARY: {
+      if (node.op == ExprOp::LOR) {
+        // a || b: 结果先置为 1, 只有 a 为 0 时才计算 b
+        return BuildShortCircuit(ctx, node.lhs, node.rhs, 1, "%lor");
+      } else if (node.op == ExprOp::LAND) {
+        // a && b: 结果先置为 0, 只有 a 不为 0 时才计算 b
+        return BuildShortCircuit(ctx, node.lhs, node.rhs, 0, "%land");
+      }
+      // 表达式没有副作用, 两个操作数的计算顺序不影响结果
+      koopa_raw_value_t lhs, rhs;
+      if (RegisterNeed(ctx, node.rhs) > RegisterNeed(ctx, node.lhs)) {
+        rhs = BuildExpr(ctx, node.rhs);
+        lhs = BuildExpr(ctx, node.lhs);
+      } else {
+        lhs = BuildExpr(ctx, node.lhs);
+        rhs = BuildExpr(ctx, node.rhs);
+      }
+      return builder.NewBinary(KoopaOp(node.op), lhs, rhs);
+    }
+  }
+  return nullptr;
+}
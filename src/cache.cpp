@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#include "cache.hpp"
+#include "trace.hpp"
+
+// 缓存条目的格式有变化时修改这个字符串, 旧的条目自然失效
+static const char kCacheFormat[] = "sysy-cache-1";
+
+// 临时文件超过这个时间 (秒) 还没有被 rename, 说明写它的进程已经退出了
+static const time_t kStaleTempSeconds = 3600;
+
+static uint64_t Fnv1a64(uint64_t hash, const char *data, size_t len) {
+  for (size_t i = 0; i < len; i ++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+static uint64_t Rotl64(uint64_t x, int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t Fmix64(uint64_t k) {
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdull;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ull;
+  k ^= k >> 33;
+  return k;
+}
+
+// 每次处理 8 字节的乘法/循环移位哈希 (与 MurmurHash3 的一路相同), 和 FNV-1a 拼成 128 位的键
+static uint64_t Mix64(uint64_t hash, const char *data, size_t len) {
+  const uint64_t c1 = 0x87c37b91114253d5ull;
+  const uint64_t c2 = 0x4cf5ad432745937full;
+  size_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    uint64_t k;
+    memcpy(&k, data + i, 8);
+    k *= c1;
+    k = Rotl64(k, 31);
+    k *= c2;
+    hash ^= k;
+    hash = Rotl64(hash, 27) * 5 + 0x52dce729;
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, len - i);
+  tail *= c1;
+  tail = Rotl64(tail, 31);
+  tail *= c2;
+  hash ^= tail;
+  return Fmix64(hash ^ len);
+}
+
+// 编译器的版本: 可执行文件的 inode, 大小和修改时间, 每次重新编译编译器都会让缓存失效
+static const std::string& CompilerVersion() {
+  static const std::string version = [] {
+    std::string ret = kCacheFormat;
+    struct stat st;
+    if (stat("/proc/self/exe", &st) == 0) {
+      ret += "/" + std::to_string(st.st_ino) + "/" + std::to_string(st.st_size) + "/" +
+             std::to_string(st.st_mtim.tv_sec) + "." + std::to_string(st.st_mtim.tv_nsec);
+    }
+    return ret;
+  }();
+  return version;
+}
+
+CompileCache::CompileCache(const std::string &dir, uint64_t max_bytes)
+    : dir_(dir), max_bytes_(max_bytes) {}
+
+bool CompileCache::Init(std::string &error) {
+  if (mkdir(dir_.c_str(), 0755) != 0 && errno != EEXIST) {
+    error = "cannot create cache directory: " + dir_;
+    return false;
+  }
+  return true;
+}
+
+std::string CompileCache::Key(const char *source, size_t size, const std::string &options) {
+  // 各部分之间用 '\0' 分隔, 避免不同的拼接方式得到相同的字节串
+  std::string header = CompilerVersion();
+  header.push_back('\0');
+  header += options;
+  header.push_back('\0');
+  uint64_t h1 = Fnv1a64(Fnv1a64(14695981039346656037ull, header.data(), header.size()),
+                        source, size);
+  uint64_t h2 = Mix64(Mix64(0, header.data(), header.size()), source, size);
+  char key[33];
+  snprintf(key, sizeof(key), "%016llx%016llx", (unsigned long long)h1, (unsigned long long)h2);
+  return key;
+}
+
+bool CompileCache::Fetch(const std::string &key, const char *output) {
+  std::string path = dir_ + "/" + key;
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    TRACE(CACHE, 1, "miss " << key);
+    misses_ ++;
+    return false;
+  }
+  struct stat st;
+  FILE *outf = nullptr;
+  bool ok = fstat(fd, &st) == 0 && (outf = fopen(output, "w")) != nullptr;
+  if (ok && st.st_size > 0) {
+    // 条目只会被整体替换 (rename), 不会被原地修改, 映射期间内容不变
+    void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      ok = fwrite(data, 1, st.st_size, outf) == (size_t)st.st_size;
+      munmap(data, st.st_size);
+    } else {
+      ok = false;
+    }
+  }
+  close(fd);
+  if (outf && fclose(outf) != 0) ok = false;
+  if (!ok) {
+    TRACE(CACHE, 1, "failed to copy " << key << " to " << output);
+    misses_ ++;
+    return false;
+  }
+  // 更新修改时间, 作为 LRU 淘汰的依据
+  utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+  TRACE(CACHE, 1, "hit " << key);
+  hits_ ++;
+  return true;
+}
+
+void CompileCache::Store(const std::string &key, const std::string &data) {
+  std::string path = dir_ + "/" + key;
+  std::string temp = dir_ + "/tmp." + key + "." + std::to_string(getpid()) + "." +
+                     std::to_string(temp_seq_ ++);
+  int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+  if (fd < 0) return;
+  size_t written = 0;
+  while (written < data.size()) {
+    ssize_t ret = write(fd, data.data() + written, data.size() - written);
+    if (ret < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    written += ret;
+  }
+  // 覆盖已有的条目 (例如同一个键被重新编译) 时, 旧条目的大小已经算在估计值里
+  struct stat old;
+  uint64_t old_size = stat(path.c_str(), &old) == 0 ? old.st_size : 0;
+  // rename 是原子的, 其他进程要么看不到这个条目, 要么看到完整的内容
+  if (close(fd) != 0 || written != data.size() || rename(temp.c_str(), path.c_str()) != 0) {
+    unlink(temp.c_str());
+    return;
+  }
+  TRACE(CACHE, 1, "store " << key << " (" << data.size() << " bytes)");
+
+  std::lock_guard<std::mutex> lock(evict_mutex_);
+  uint64_t estimate = estimated_bytes_ - std::min(old_size, estimated_bytes_) + data.size();
+  // 第一次写入时扫描一遍目录, 之后只在估计的总大小超过上限时再扫描
+  // 扫描得到的总大小已经包括刚写入的条目, 不能再加一次
+  if (!scanned_ || estimate > max_bytes_) {
+    Evict();
+  } else {
+    estimated_bytes_ = estimate;
+  }
+}
+
+void CompileCache::Evict() {
+  struct Entry {
+    std::string path;
+    uint64_t size;
+    struct timespec mtime;
+  };
+  DIR *dir = opendir(dir_.c_str());
+  if (!dir) return;
+  scans_ ++;
+  std::vector<Entry> entries;
+  uint64_t total = 0;
+  time_t now = time(nullptr);
+  while (struct dirent *ent = readdir(dir)) {
+    if (ent->d_name[0] == '.') continue;
+    std::string path = dir_ + "/" + ent->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    if (strncmp(ent->d_name, "tmp.", 4) == 0) {
+      // 正在写的临时文件不计入总大小, 长时间没有 rename 的残留文件直接删掉
+      if (now - st.st_mtime > kStaleTempSeconds) unlink(path.c_str());
+      continue;
+    }
+    entries.push_back({path, (uint64_t)st.st_size, st.st_mtim});
+    total += st.st_size;
+  }
+  closedir(dir);
+
+  if (total > max_bytes_) {
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+      if (a.mtime.tv_sec != b.mtime.tv_sec) return a.mtime.tv_sec < b.mtime.tv_sec;
+      return a.mtime.tv_nsec < b.mtime.tv_nsec;
+    });
+    for (const auto &entry : entries) {
+      if (total <= max_bytes_) break;
+      // 其他进程可能同时在淘汰, 文件已经不存在也没关系
+      unlink(entry.path.c_str());
+      total -= entry.size;
+      TRACE(CACHE, 2, "evict " << entry.path);
+    }
+  }
+  scanned_ = true;
+  estimated_bytes_ = total;
+}
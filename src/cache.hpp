@@ -0,0 +1,57 @@
+#ifndef __CACHE_HPP__
+#define __CACHE_HPP__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+// 按内容寻址的编译结果缓存 (-cache-dir)
+// 键是源程序字节, 模式, 优化选项和编译器版本的 128 位哈希, 值是完整的输出文件
+// 每个条目是目录中的一个文件, 先写临时文件再 rename, 所以多个进程/线程可以同时使用同一个目录
+// 命中时更新文件的修改时间, 总大小超过上限时按修改时间从旧到新淘汰 (LRU)
+class CompileCache {
+ public:
+  static constexpr uint64_t kDefaultMaxBytes = 256ull << 20;
+
+  CompileCache(const std::string &dir, uint64_t max_bytes);
+  CompileCache(const CompileCache&) = delete;
+  CompileCache& operator=(const CompileCache&) = delete;
+
+  // 创建缓存目录, 失败时返回 false
+  bool Init(std::string &error);
+
+  // 计算一次编译的键, options 是影响输出的所有选项拼成的字符串
+  static std::string Key(const char *source, size_t size, const std::string &options);
+
+  // 命中时把缓存的结果写到 output 并返回 true
+  bool Fetch(const std::string &key, const char *output);
+  // 保存一次编译的结果, 失败时什么都不做 (缓存只影响速度)
+  void Store(const std::string &key, const std::string &data);
+
+  uint64_t Hits() const { return hits_; }
+  uint64_t Misses() const { return misses_; }
+  // 扫描缓存目录 (检查总大小, 必要时淘汰) 的次数
+  uint64_t Scans() const { return scans_; }
+
+ private:
+  // 扫描缓存目录, 总大小超过上限时删除最久未使用的条目, 调用时需要持有 evict_mutex_
+  void Evict();
+
+  std::string dir_;
+  uint64_t max_bytes_;
+  std::atomic<uint64_t> hits_{0};
+  std::atomic<uint64_t> misses_{0};
+  std::atomic<uint64_t> scans_{0};
+  // 临时文件名的序号, 与 pid 一起保证不同线程/进程的临时文件不冲突
+  std::atomic<uint64_t> temp_seq_{0};
+  // 保护下面两个成员, 同一进程内同时只有一个线程做淘汰
+  std::mutex evict_mutex_;
+  // 是否已经扫描过缓存目录
+  bool scanned_ = false;
+  // 上次扫描得到的总大小加上之后本进程写入的大小, 不包括其他进程的写入
+  uint64_t estimated_bytes_ = 0;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef __COMPILE_CONTEXT_HPP__
+#define __COMPILE_CONTEXT_HPP__
+
+#include <string>
+#include "arena.hpp"
+#include "ast.hpp"
+#include "expr_pool.hpp"
+#include "intern.hpp"
+
+// 可重入 lexer 的状态句柄, 与 Flex 生成的代码中的定义相同
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+
+// 一次编译 (一个输入文件) 的前端状态, 由 lexer 和 parser 填充
+// 不同的编译各自持有一份, 之间不共享任何可变状态, 可以在不同线程中同时进行
+struct CompileContext {
+  CompileContext() = default;
+  CompileContext(const CompileContext&) = delete;
+  CompileContext& operator=(const CompileContext&) = delete;
+
+  // 丢弃上一次编译的结果, 保留已经申请的内存, 用于 -serve 模式连续处理多个请求
+  void Reset(const char *name) {
+    filename = name;
+    source = "";
+    source_size = 0;
+    arena.Reset();
+    interner.Clear();
+    exprs.Clear();
+    ast = nullptr;
+    error.clear();
+  }
+
+  // 输入文件名, 仅用于报错
+  const char *filename = "";
+  // 正在解析的源程序 (SourceBuffer 中的内容), token 的位置是相对它的偏移
+  const char *source = "";
+  size_t source_size = 0;
+  // 语句层面的 AST 节点, 编译结束时一次性释放
+  Arena arena;
+  StringInterner interner;
+  // 表达式节点
+  ExprPool exprs;
+  // 解析得到的 AST 根节点
+  BaseAST *ast = nullptr;
+  // 解析失败时的错误信息 (文件名:行:列: error: ...), 由 yyerror 填写
+  std::string error;
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "ast.hpp"
+#include "cache.hpp"
+#include "compile_context.hpp"
+#include "driver.hpp"
+#include "koopa_dump.hpp"
+#include "opt.hpp"
+#include "output.hpp"
+#include "schedule.hpp"
+#include "simulator.hpp"
+#include "source_buffer.hpp"
+#include "visit.hpp"
+
+// Flex 生成的可重入 lexer 的接口, 以及 Bison 生成的 parser
+// 为什么不引用 sysy.tab.hpp 呢? 因为这个文件不是我们自己写的, 而是被 Bison 生成出来的
+// 你的代码编辑器/IDE 很可能找不到这个文件, 然后会给你报错 (虽然编译不会出错)
+struct yy_buffer_state;
+extern int yylex_init(yyscan_t *scanner);
+extern yy_buffer_state *yy_scan_buffer(char *base, size_t size, yyscan_t scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern int yyparse(yyscan_t scanner, CompileContext &cc);
+
+// 解析 source 到 cc 中, lexer 直接在 source 的内存上扫描
+static bool Parse(SourceBuffer &source, CompileContext &cc) {
+  cc.source = source.Data();
+  cc.source_size = source.Size();
+  yyscan_t scanner;
+  yylex_init(&scanner);
+  // 缓冲区随 yylex_destroy 一起释放, 但其中的数据属于 source
+  yy_scan_buffer(source.ScanBase(), source.ScanSize(), scanner);
+  int ret = yyparse(scanner, cc);
+  yylex_destroy(scanner);
+  return ret == 0 && cc.ast != nullptr;
+}
+
+// -sim: 在内置的模拟器上运行目标文件, 把 main 的返回值, 指令数和估算的周期数写进 out
+static void RunSimulation(const CompileOptions &options, const char *object, size_t size,
+                          OutputSink &out, PassTimer &timer) {
+  timer.Start("sim");
+  SimOptions sim;
+  sim.model = FindSchedModel(options.sim_model);
+  SimResult result = Simulate(object, size, sim);
+  timer.AddCounter("sim.instructions", result.instructions);
+  timer.AddCounter("sim.cycles", result.cycles);
+  out << "exit: " << result.exit_value << "\n";
+  out << "instructions: " << std::to_string(result.instructions) << "\n";
+  out << "cycles: " << std::to_string(result.cycles) << "\n";
+}
+
+bool CompileSource(const CompileOptions &options, SourceBuffer &source, CompileContext &cc,
+                   OutputSink &out, PassTimer &timer, std::string &error) {
+  // -sim 的输入也可以是 -elf 生成的目标文件, 直接运行
+  if (options.mode == "-sim" && source.Size() >= 4 &&
+      memcmp(source.Data(), "\x7f" "ELF", 4) == 0) {
+    try {
+      RunSimulation(options, source.Data(), source.Size(), out, timer);
+    } catch (const std::string &message) {
+      error = std::string(cc.filename) + ": error: " + message;
+      return false;
+    }
+    return true;
+  }
+
+  timer.Start("parse");
+  if (!Parse(source, cc)) {
+    error = cc.error.empty() ? std::string("failed to parse ") + cc.filename : cc.error;
+    return false;
+  }
+
+  try {
+    // 直接在内存中生成 Koopa IR
+    timer.Start("irgen");
+    BuildContext ctx(cc.exprs, cc.interner);
+    ctx.fold = options.fold;
+    cc.ast->Build(ctx);
+    koopa_raw_program_t raw = ctx.builder.Finish();
+    if (options.opt_level >= 1) {
+      timer.Start("opt");
+      OptStats stats = OptimizeProgram(raw, ctx.builder, options.fold);
+      timer.AddCounter("opt.folded", stats.folded);
+      timer.AddCounter("opt.cse", stats.cse);
+      timer.AddCounter("opt.removed", stats.removed);
+    }
+    if (options.mode == "-koopa") {
+      timer.Start("koopa-print");
+      DumpKoopa(raw, out);
+    } else if (options.mode == "-riscv" || options.mode == "-elf" || options.mode == "-sim") {
+      timer.Start("codegen");
+      CodegenOptions codegen;
+      codegen.emit_object = options.mode != "-riscv";
+      if (options.opt_level >= 1) {
+        codegen.peephole_window = options.peephole_window;
+        codegen.sched_model = FindSchedModel(options.sched_model);
+      }
+      CodegenStats stats;
+      std::string object;
+      if (options.mode == "-sim") {
+        // 目标文件只放在内存里, 输出的是运行的结果
+        OutputSink object_out;
+        object_out.Capture(&object);
+        stats = Visit(raw, object_out, codegen);
+      } else {
+        stats = Visit(raw, out, codegen);
+      }
+      if (codegen.peephole_window > 0) timer.AddCounter("peephole.removed", stats.peephole_removed);
+      if (codegen.sched_model) {
+        timer.AddCounter("sched.cycles_before", stats.sched.cycles_before);
+        timer.AddCounter("sched.cycles_after", stats.sched.cycles_after);
+      }
+      if (options.mode == "-sim") RunSimulation(options, object.data(), object.size(), out, timer);
+    }
+  } catch (const std::string &message) {
+    error = std::string(cc.filename) + ": error: " + message;
+    return false;
+  }
+  return true;
+}
+
+// 影响输出的所有选项, 作为缓存键的一部分. 给 CompileOptions 加新选项时也要加到这里
+static std::string CacheOptions(const CompileOptions &options) {
+  return options.mode + " -O" + std::to_string(options.opt_level) +
+         (options.fold ? "" : " -fno-fold") +
+         " -peephole-window=" + std::to_string(options.peephole_window) +
+         " -sched-model=" + options.sched_model + " -sim-model=" + options.sim_model;
+}
+
+// 带缓存的 CompileFile: 源程序只映射一次, 既用来计算键, 也直接交给 lexer
+static bool CompileFileCached(const CompileOptions &options, const char *input,
+                              const char *output, PassTimer &timer, std::string &error) {
+  timer.Start("cache");
+  SourceBuffer source;
+  if (!source.Open(input)) {
+    error = std::string("cannot open input file: ") + input;
+    timer.Stop();
+    return false;
+  }
+  std::string key = CompileCache::Key(source.Data(), source.Size(), CacheOptions(options));
+  if (options.cache->Fetch(key, output)) {
+    timer.Stop();
+    return true;
+  }
+
+  FILE *outf = fopen(output, "w");
+  if (!outf) {
+    error = std::string("cannot open output file: ") + output;
+    timer.Stop();
+    return false;
+  }
+  std::string result;
+  bool ok;
+  {
+    OutputSink out(nullptr, 1 << 20);
+    out.Capture(&result);
+    CompileContext cc;
+    cc.filename = input;
+    ok = CompileSource(options, source, cc, out, timer, error);
+    out.Flush();
+  }
+  timer.Start("write");
+  fwrite(result.data(), 1, result.size(), outf);
+  fclose(outf);
+  // 只缓存成功的编译, 出错时每次都重新编译以便报告错误
+  if (ok) {
+    timer.Start("cache");
+    options.cache->Store(key, result);
+  }
+  timer.Stop();
+  return ok;
+}
+
+bool CompileFile(const CompileOptions &options, const char *input, const char *output,
+                 PassTimer &timer, std::string &error) {
+  if (options.cache) return CompileFileCached(options, input, output, timer, error);
+  FILE *outf = fopen(output, "w");
+  if (!outf) {
+    error = std::string("cannot open output file: ") + output;
+    return false;
+  }
+  bool ok;
+  {
+    // IR/汇编直接写入输出缓冲区, 最后一次性落盘
+    OutputSink out(outf, 1 << 20);
+    // 映射输入文件, 交给这次编译自己的 lexer
+    SourceBuffer source;
+    if (source.Open(input)) {
+      CompileContext cc;
+      cc.filename = input;
+      ok = CompileSource(options, source, cc, out, timer, error);
+    } else {
+      error = std::string("cannot open input file: ") + input;
+      ok = false;
+    }
+    timer.Start("write");
+    out.Flush();
+  }
+  fclose(outf);
+  timer.Stop();
+  return ok;
+}
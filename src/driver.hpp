@@ -0,0 +1,42 @@
+#ifndef __DRIVER_HPP__
+#define __DRIVER_HPP__
+
+#include <string>
+#include "pass_timer.hpp"
+
+class CompileCache;
+struct CompileContext;
+class OutputSink;
+class SourceBuffer;
+
+// 与具体输入文件无关的编译选项
+struct CompileOptions {
+  // -koopa, -riscv, -elf 或 -sim
+  std::string mode;
+  // -O0 / -O1
+  int opt_level = 0;
+  // -fno-fold 时为 false: 前端和 -O1 都不做常量折叠, 常量运算也交给后端, 用于测试指令选择等
+  bool fold = true;
+  // -peephole-window=N, 窥孔优化每条规则最多向前看的指令数, 只在 -O1 时生效, 0 表示关闭
+  int peephole_window = 4;
+  // -sched-model=名字, 指令调度使用的延迟模型 (见 src/schedule.hpp), 只在 -O1 时生效, none 表示关闭
+  std::string sched_model = "generic";
+  // -sim-model=名字, -sim 模式估算周期数用的延迟模型, 与 -sched-model 的名字相同 (不能是 none)
+  std::string sim_model = "generic";
+  // -cache-dir, 为空时不使用缓存. 可以被多个线程共享
+  CompileCache *cache = nullptr;
+};
+
+// 解析已经读入的源程序 source, 生成的 IR/汇编写进 out
+// cc 由调用者提供 (需要先设置好 filename), 可以在多次编译之间 Reset 后复用
+bool CompileSource(const CompileOptions &options, SourceBuffer &source, CompileContext &cc,
+                   OutputSink &out, PassTimer &timer, std::string &error);
+
+// 编译一个文件: 解析 input, 生成 IR/汇编写到 output
+// 启用缓存时, 命中则直接把缓存的结果复制到 output, 不做任何解析和代码生成
+// 所有状态都在函数内部创建, 不同线程可以同时调用
+// 失败时返回 false, 并把错误信息写到 error
+bool CompileFile(const CompileOptions &options, const char *input, const char *output,
+                 PassTimer &timer, std::string &error);
+
+#endif
@@ -0,0 +1,170 @@
+#include "elf_writer.hpp"
+
+namespace {
+
+// ELF32 中用到的常量, 见 System V ABI 和 RISC-V psABI
+constexpr uint16_t kElfTypeRel = 1;
+constexpr uint16_t kElfMachineRiscv = 243;
+constexpr uint32_t kSectionProgbits = 1, kSectionSymtab = 2, kSectionStrtab = 3;
+constexpr uint32_t kFlagAlloc = 0x2, kFlagExec = 0x4;
+constexpr uint8_t kBindLocal = 0, kBindGlobal = 1;
+constexpr uint8_t kSymNoType = 0, kSymFunc = 2, kSymSection = 3;
+constexpr size_t kElfHeaderSize = 52, kSectionHeaderSize = 40, kSymbolSize = 16;
+
+// 小端序的输出缓冲区
+struct Bytes {
+  std::string data;
+
+  void U8(uint8_t value) { data.push_back((char)value); }
+  void U16(uint16_t value) {
+    U8(value & 0xff);
+    U8(value >> 8);
+  }
+  void U32(uint32_t value) {
+    U16(value & 0xffff);
+    U16(value >> 16);
+  }
+  void Align(size_t alignment) {
+    while (data.size() % alignment) U8(0);
+  }
+  size_t Size() const { return data.size(); }
+};
+
+// 字符串表: 第一个字节总是空字符串
+struct StringTable {
+  std::string data = std::string(1, '\0');
+
+  uint32_t Add(const std::string &str) {
+    uint32_t offset = data.size();
+    data += str;
+    data.push_back('\0');
+    return offset;
+  }
+};
+
+struct SectionHeader {
+  uint32_t name = 0;
+  uint32_t type = 0;
+  uint32_t flags = 0;
+  uint32_t offset = 0;
+  uint32_t size = 0;
+  uint32_t link = 0;
+  uint32_t info = 0;
+  uint32_t align = 0;
+  uint32_t entsize = 0;
+};
+
+}  // namespace
+
+void ElfObjectWriter::AddFunction(const std::string &name, size_t offset, size_t size) {
+  symbols_.push_back({name, offset, size});
+}
+
+void ElfObjectWriter::Write(OutputSink &out) const {
+  // 节的编号, 0 号是空节
+  constexpr uint16_t text_index = 1, symtab_index = 2, strtab_index = 3, shstrtab_index = 4;
+  constexpr uint16_t section_count = 5;
+
+  // 符号表: 空符号, .text 的节符号 (局部符号必须排在前面), 然后是全局符号
+  constexpr uint32_t kFirstGlobal = 2;
+  Bytes symtab;
+  StringTable strtab;
+  auto add_symbol = [&symtab](uint32_t name, uint32_t value, uint32_t size, uint8_t bind,
+                              uint8_t type, uint16_t section) {
+    symtab.U32(name);
+    symtab.U32(value);
+    symtab.U32(size);
+    symtab.U8(bind << 4 | type);
+    symtab.U8(0);
+    symtab.U16(section);
+  };
+  add_symbol(0, 0, 0, kBindLocal, kSymNoType, 0);
+  add_symbol(0, 0, 0, kBindLocal, kSymSection, text_index);
+  for (const Symbol &symbol : symbols_) {
+    add_symbol(strtab.Add(symbol.name), symbol.offset, symbol.size, kBindGlobal, kSymFunc,
+               text_index);
+  }
+
+  StringTable shstrtab;
+  std::vector<SectionHeader> sections(section_count);
+  Bytes file;
+  // ELF 头最后再填, 先占好位置
+  file.data.resize(kElfHeaderSize);
+
+  SectionHeader &text = sections[text_index];
+  text.name = shstrtab.Add(".text");
+  text.type = kSectionProgbits;
+  text.flags = kFlagAlloc | kFlagExec;
+  text.offset = file.Size();
+  text.size = text_.size();
+  text.align = 4;
+  file.data.append(text_.begin(), text_.end());
+  file.Align(4);
+
+  SectionHeader &symtab_section = sections[symtab_index];
+  symtab_section.name = shstrtab.Add(".symtab");
+  symtab_section.type = kSectionSymtab;
+  symtab_section.offset = file.Size();
+  symtab_section.size = symtab.Size();
+  symtab_section.link = strtab_index;
+  // info 是第一个全局符号的编号
+  symtab_section.info = kFirstGlobal;
+  symtab_section.align = 4;
+  symtab_section.entsize = kSymbolSize;
+  file.data += symtab.data;
+
+  SectionHeader &strtab_section = sections[strtab_index];
+  strtab_section.name = shstrtab.Add(".strtab");
+  strtab_section.type = kSectionStrtab;
+  strtab_section.offset = file.Size();
+  strtab_section.size = strtab.data.size();
+  strtab_section.align = 1;
+  file.data += strtab.data;
+
+  SectionHeader &shstrtab_section = sections[shstrtab_index];
+  shstrtab_section.name = shstrtab.Add(".shstrtab");
+  shstrtab_section.type = kSectionStrtab;
+  shstrtab_section.offset = file.Size();
+  shstrtab_section.size = shstrtab.data.size();
+  shstrtab_section.align = 1;
+  file.data += shstrtab.data;
+
+  file.Align(4);
+  uint32_t section_header_offset = file.Size();
+  for (const SectionHeader &section : sections) {
+    file.U32(section.name);
+    file.U32(section.type);
+    file.U32(section.flags);
+    file.U32(0);  // 地址, 可重定位文件中为 0
+    file.U32(section.offset);
+    file.U32(section.size);
+    file.U32(section.link);
+    file.U32(section.info);
+    file.U32(section.align);
+    file.U32(section.entsize);
+  }
+
+  Bytes header;
+  // e_ident: 魔数, ELFCLASS32, 小端序, 版本 1, System V ABI
+  header.data = std::string("\x7f" "ELF", 4);
+  header.U8(1);
+  header.U8(1);
+  header.U8(1);
+  header.Align(16);
+  header.U16(kElfTypeRel);
+  header.U16(kElfMachineRiscv);
+  header.U32(1);  // e_version
+  header.U32(0);  // e_entry
+  header.U32(0);  // e_phoff
+  header.U32(section_header_offset);
+  header.U32(0);  // e_flags: 没有 C 扩展, 软浮点 ABI
+  header.U16(kElfHeaderSize);
+  header.U16(0);  // e_phentsize
+  header.U16(0);  // e_phnum
+  header.U16(kSectionHeaderSize);
+  header.U16(section_count);
+  header.U16(shstrtab_index);
+  file.data.replace(0, kElfHeaderSize, header.data);
+
+  out.Write(file.data.data(), file.data.size());
+}
@@ -0,0 +1,34 @@
+#ifndef __ELF_WRITER_HPP__
+#define __ELF_WRITER_HPP__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "output.hpp"
+
+// 生成 RV32 的可重定位 ELF 目标文件 (ELFCLASS32, 小端序, ilp32 软浮点 ABI)
+// 节: .text, .symtab, .strtab, .shstrtab
+// 符号表中除了 .text 的节符号之外, 每个函数是一个全局的 FUNC 符号 (对应汇编输出中的 .globl)
+// 生成的代码还不会引用其他函数或全局变量, 所以没有重定位 (.rela.text), 需要时由指令选择报错
+class ElfObjectWriter {
+ public:
+  // .text 的内容, 编码器直接把指令追加到末尾
+  std::vector<uint8_t>& Text() { return text_; }
+
+  // 定义函数 name, 位于 .text 的 [offset, offset + size)
+  void AddFunction(const std::string &name, size_t offset, size_t size);
+
+  void Write(OutputSink &out) const;
+
+ private:
+  struct Symbol {
+    std::string name;
+    size_t offset;
+    size_t size;
+  };
+
+  std::vector<uint8_t> text_;
+  std::vector<Symbol> symbols_;
+};
+
+#endif
@@ -0,0 +1,239 @@
+#include <cassert>
+#include <string>
+#include <unordered_map>
+#include "encoder.hpp"
+
+namespace {
+
+// 基本指令格式, 字段的位置见 RISC-V 规范第 2 章
+uint32_t EncodeR(uint32_t opcode, uint32_t funct3, uint32_t funct7, int rd, int rs1, int rs2) {
+  return funct7 << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 | funct3 << 12 |
+         (uint32_t)rd << 7 | opcode;
+}
+
+uint32_t EncodeI(uint32_t opcode, uint32_t funct3, int rd, int rs1, int32_t imm) {
+  return ((uint32_t)imm & 0xfff) << 20 | (uint32_t)rs1 << 15 | funct3 << 12 |
+         (uint32_t)rd << 7 | opcode;
+}
+
+uint32_t EncodeS(uint32_t funct3, int rs1, int rs2, int32_t imm) {
+  uint32_t u = imm;
+  return (u >> 5 & 0x7f) << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 | funct3 << 12 |
+         (u & 0x1f) << 7 | 0x23;
+}
+
+uint32_t EncodeB(uint32_t funct3, int rs1, int rs2, int32_t offset) {
+  uint32_t u = offset;
+  return (u >> 12 & 1) << 31 | (u >> 5 & 0x3f) << 25 | (uint32_t)rs2 << 20 |
+         (uint32_t)rs1 << 15 | funct3 << 12 | (u >> 1 & 0xf) << 8 | (u >> 11 & 1) << 7 | 0x63;
+}
+
+uint32_t EncodeU(int rd, int32_t imm20) {
+  return ((uint32_t)imm20 & 0xfffff) << 12 | (uint32_t)rd << 7 | 0x37;
+}
+
+uint32_t EncodeJ(int rd, int32_t offset) {
+  uint32_t u = offset;
+  return (u >> 20 & 1) << 31 | (u >> 1 & 0x3ff) << 21 | (u >> 11 & 1) << 20 |
+         (u >> 12 & 0xff) << 12 | (uint32_t)rd << 7 | 0x6f;
+}
+
+constexpr uint32_t kOpImm = 0x13, kOp = 0x33, kLoad = 0x03, kJalr = 0x67;
+
+// li 超出 12 位时拆成 lui + addi, 低 12 位按有符号数处理, 所以高位要先加上 0x800
+// 与汇编器一样, 低 12 位为 0 时只有 lui
+int32_t HiPart(int32_t value) {
+  return (int32_t)(((uint32_t)value + 0x800) >> 12 & 0xfffff);
+}
+
+int32_t LoPart(int32_t value) {
+  return (int32_t)((uint32_t)value << 20) >> 20;
+}
+
+bool IsBranch(const MachineInst &inst) {
+  MachineFormat format = inst.Info().format;
+  return format == MachineFormat::BRANCH_Z || format == MachineFormat::BRANCH;
+}
+
+// 条件相反的分支, 用来跳过长跳转
+MachineOp InvertBranch(MachineOp op) {
+  switch (op) {
+    case MachineOp::BEQZ: return MachineOp::BNEZ;
+    case MachineOp::BNEZ: return MachineOp::BEQZ;
+    case MachineOp::BEQ: return MachineOp::BNE;
+    case MachineOp::BNE: return MachineOp::BEQ;
+    case MachineOp::BLT: return MachineOp::BGE;
+    case MachineOp::BGE: return MachineOp::BLT;
+    default:
+      assert(false);
+      return op;
+  }
+}
+
+class FunctionEncoder {
+ public:
+  FunctionEncoder(const MachineFunction &func, std::vector<uint8_t> &code)
+      : func_(func), insts_(func.insts), code_(code), base_(code.size()),
+        long_branch_(insts_.size()), offsets_(insts_.size()) {}
+
+  void Run() {
+    Layout();
+    for (size_t i = 0; i < insts_.size(); i ++) Encode(i);
+  }
+
+ private:
+  // 每条指令编码后的字节数
+  size_t Size(size_t i) const {
+    const MachineInst &inst = insts_[i];
+    switch (inst.op) {
+      case MachineOp::LABEL:
+        return 0;
+      case MachineOp::LI:
+        return FitsImm12(inst.imm) || LoPart(inst.imm) == 0 ? 4 : 8;
+      default:
+        return long_branch_[i] ? 8 : 4;
+    }
+  }
+
+  // 确定每条指令的位置: 先假设所有分支都在范围内, 把超出范围的改成长分支之后重新计算,
+  // 指令只会变长, 所以一定会收敛
+  void Layout() {
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      size_t offset = 0;
+      for (size_t i = 0; i < insts_.size(); i ++) {
+        offsets_[i] = offset;
+        if (insts_[i].IsLabel()) label_offsets_[insts_[i].target] = offset;
+        offset += Size(i);
+      }
+      for (size_t i = 0; i < insts_.size(); i ++) {
+        if (!IsBranch(insts_[i]) || long_branch_[i]) continue;
+        int64_t distance = Distance(i);
+        if (distance < -4096 || distance > 4094) {
+          long_branch_[i] = true;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // 从指令 i 到它的跳转目标的字节数
+  // 目标只能是同一个函数中的标号, 跳到函数之外需要重定位, 目前不支持
+  int64_t Distance(size_t i) const {
+    auto it = label_offsets_.find(insts_[i].target);
+    if (it == label_offsets_.end()) {
+      throw std::string("branch target outside of function ") + func_.name +
+            " needs a relocation, which -elf does not emit yet";
+    }
+    return (int64_t)it->second - (int64_t)offsets_[i];
+  }
+
+  void Put(uint32_t word) {
+    for (int k = 0; k < 4; k ++) code_.push_back(word >> (8 * k) & 0xff);
+  }
+
+  void PutBranch(MachineOp op, int rs1, int rs2, int32_t offset) {
+    switch (op) {
+      case MachineOp::BEQZ: Put(EncodeB(0, rs1, RV_ZERO, offset)); break;
+      case MachineOp::BNEZ: Put(EncodeB(1, rs1, RV_ZERO, offset)); break;
+      case MachineOp::BEQ: Put(EncodeB(0, rs1, rs2, offset)); break;
+      case MachineOp::BNE: Put(EncodeB(1, rs1, rs2, offset)); break;
+      case MachineOp::BLT: Put(EncodeB(4, rs1, rs2, offset)); break;
+      case MachineOp::BGE: Put(EncodeB(5, rs1, rs2, offset)); break;
+      default: assert(false);
+    }
+  }
+
+  void PutJump(int64_t distance) {
+    if (distance < -(1 << 20) || distance >= (1 << 20)) {
+      throw std::string("function too large to encode: ") + func_.name;
+    }
+    Put(EncodeJ(RV_ZERO, (int32_t)distance));
+  }
+
+  void Encode(size_t i);
+
+  const MachineFunction &func_;
+  const std::vector<MachineInst> &insts_;
+  std::vector<uint8_t> &code_;
+  // 函数在 code 中的起始位置, 偏移都相对于它
+  size_t base_;
+  std::vector<bool> long_branch_;
+  std::vector<size_t> offsets_;
+  std::unordered_map<koopa_raw_basic_block_t, size_t> label_offsets_;
+};
+
+void FunctionEncoder::Encode(size_t i) {
+  const MachineInst &inst = insts_[i];
+  assert(code_.size() - base_ == offsets_[i]);
+  assert(!IsVirtualReg(inst.rd) && !IsVirtualReg(inst.rs1) && !IsVirtualReg(inst.rs2));
+  int rd = inst.rd, rs1 = inst.rs1, rs2 = inst.rs2;
+  switch (inst.op) {
+    case MachineOp::ADD: Put(EncodeR(kOp, 0, 0x00, rd, rs1, rs2)); break;
+    case MachineOp::SUB: Put(EncodeR(kOp, 0, 0x20, rd, rs1, rs2)); break;
+    case MachineOp::MUL: Put(EncodeR(kOp, 0, 0x01, rd, rs1, rs2)); break;
+    case MachineOp::MULH: Put(EncodeR(kOp, 1, 0x01, rd, rs1, rs2)); break;
+    case MachineOp::DIV: Put(EncodeR(kOp, 4, 0x01, rd, rs1, rs2)); break;
+    case MachineOp::REM: Put(EncodeR(kOp, 6, 0x01, rd, rs1, rs2)); break;
+    case MachineOp::AND: Put(EncodeR(kOp, 7, 0x00, rd, rs1, rs2)); break;
+    case MachineOp::OR: Put(EncodeR(kOp, 6, 0x00, rd, rs1, rs2)); break;
+    case MachineOp::XOR: Put(EncodeR(kOp, 4, 0x00, rd, rs1, rs2)); break;
+    case MachineOp::SLL: Put(EncodeR(kOp, 1, 0x00, rd, rs1, rs2)); break;
+    case MachineOp::SRL: Put(EncodeR(kOp, 5, 0x00, rd, rs1, rs2)); break;
+    case MachineOp::SRA: Put(EncodeR(kOp, 5, 0x20, rd, rs1, rs2)); break;
+    case MachineOp::SLT: Put(EncodeR(kOp, 2, 0x00, rd, rs1, rs2)); break;
+    // sgt rd, a, b 就是 slt rd, b, a
+    case MachineOp::SGT: Put(EncodeR(kOp, 2, 0x00, rd, rs2, rs1)); break;
+    case MachineOp::ADDI: Put(EncodeI(kOpImm, 0, rd, rs1, inst.imm)); break;
+    case MachineOp::ANDI: Put(EncodeI(kOpImm, 7, rd, rs1, inst.imm)); break;
+    case MachineOp::ORI: Put(EncodeI(kOpImm, 6, rd, rs1, inst.imm)); break;
+    case MachineOp::XORI: Put(EncodeI(kOpImm, 4, rd, rs1, inst.imm)); break;
+    case MachineOp::SLTI: Put(EncodeI(kOpImm, 2, rd, rs1, inst.imm)); break;
+    // 移位量在立即数的低 5 位, srai 的高位是 0x20
+    case MachineOp::SLLI: Put(EncodeI(kOpImm, 1, rd, rs1, inst.imm & 0x1f)); break;
+    case MachineOp::SRLI: Put(EncodeI(kOpImm, 5, rd, rs1, inst.imm & 0x1f)); break;
+    case MachineOp::SRAI: Put(EncodeI(kOpImm, 5, rd, rs1, 0x400 | (inst.imm & 0x1f))); break;
+    case MachineOp::LUI: Put(EncodeU(rd, inst.imm)); break;
+    case MachineOp::LI:
+      if (FitsImm12(inst.imm)) {
+        Put(EncodeI(kOpImm, 0, rd, RV_ZERO, inst.imm));
+      } else {
+        Put(EncodeU(rd, HiPart(inst.imm)));
+        if (LoPart(inst.imm) != 0) Put(EncodeI(kOpImm, 0, rd, rd, LoPart(inst.imm)));
+      }
+      break;
+    case MachineOp::MV: Put(EncodeI(kOpImm, 0, rd, rs1, 0)); break;
+    // seqz rd, rs 是 sltiu rd, rs, 1; snez rd, rs 是 sltu rd, zero, rs
+    case MachineOp::SEQZ: Put(EncodeI(kOpImm, 3, rd, rs1, 1)); break;
+    case MachineOp::SNEZ: Put(EncodeR(kOp, 3, 0x00, rd, RV_ZERO, rs1)); break;
+    case MachineOp::LW: Put(EncodeI(kLoad, 2, rd, rs1, inst.imm)); break;
+    case MachineOp::SW: Put(EncodeS(2, rs1, rs2, inst.imm)); break;
+    case MachineOp::BEQZ:
+    case MachineOp::BNEZ:
+    case MachineOp::BEQ:
+    case MachineOp::BNE:
+    case MachineOp::BLT:
+    case MachineOp::BGE:
+      if (long_branch_[i]) {
+        // 条件不成立时跳过后面的 j
+        PutBranch(InvertBranch(inst.op), rs1, rs2, 8);
+        PutJump(Distance(i) - 4);
+      } else {
+        PutBranch(inst.op, rs1, rs2, (int32_t)Distance(i));
+      }
+      break;
+    case MachineOp::J: PutJump(Distance(i)); break;
+    case MachineOp::RET: Put(EncodeI(kJalr, 0, RV_ZERO, RV_RA, 0)); break;
+    case MachineOp::LABEL: break;
+    default:
+      assert(false);
+  }
+}
+
+}  // namespace
+
+void EncodeMachineFunction(const MachineFunction &func, std::vector<uint8_t> &code) {
+  FunctionEncoder encoder(func, code);
+  encoder.Run();
+}
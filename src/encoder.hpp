@@ -0,0 +1,14 @@
+#ifndef __ENCODER_HPP__
+#define __ENCODER_HPP__
+
+#include <cstdint>
+#include <vector>
+#include "mir.hpp"
+
+// 把一个函数的机器指令编码成 RV32IM 的二进制, 按小端序追加到 code 末尾
+// 伪指令按汇编器的方式展开 (li, mv, seqz, snez, sgt, beqz, bnez, j, ret),
+// 跳转目标都是同一函数内的标号, 直接算出偏移, 不需要重定位
+// 超出 ±4KiB 的条件分支改写成反向的分支跳过一条 j, 函数超过 j 的 ±1MiB 范围时报错
+void EncodeMachineFunction(const MachineFunction &func, std::vector<uint8_t> &code);
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef __EXPR_POOL_HPP__
+#define __EXPR_POOL_HPP__
+
+#include <cstdint>
+#include <vector>
+#include "intern.hpp"
+
+// 表达式节点在 ExprPool 中的下标
+using ExprId = uint32_t;
+constexpr ExprId kNoExpr = UINT32_MAX;
+
+enum class ExprKind : uint8_t {
+  NUMBER,
+  LVAL,
+  UNARY,
+  BINARY
+};
+
+enum class ExprOp : uint8_t {
+  NONE,
+  // 一元运算, 一元 '+' 在解析时直接去掉
+  NEG,
+  NOT,
+  // 二元运算
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  MOD,
+  LT,
+  GT,
+  LE,
+  GE,
+  EQ,
+  NE,
+  LAND,
+  LOR
+};
+
+// 常量折叠的缓存状态
+enum class FoldState : uint8_t {
+  UNKNOWN,
+  CONST,
+  NOT_CONST
+};
+
+// 一个表达式节点, 16 字节
+// 语法里 Exp -> LOrExp -> ... -> PrimaryExp 这些只起传递作用的层级在解析时就被折叠掉了,
+// 一个字面量只对应一个 NUMBER 节点
+struct ExprNode {
+  ExprKind kind;
+  ExprOp op;
+  FoldState fold_state;
+  // Sethi-Ullman 标号: 求这个子表达式的值最少需要同时占用的寄存器数, 0 表示还没有计算
+  uint8_t reg_need;
+  union {
+    // NUMBER: 字面量的值
+    int32_t number;
+    // LVAL: 标识符
+    SymbolId symbol;
+    // UNARY/BINARY: (左) 操作数
+    ExprId lhs;
+  };
+  // BINARY: 右操作数
+  ExprId rhs;
+  // fold_state 为 CONST 时的值
+  int32_t fold_value;
+};
+static_assert(sizeof(ExprNode) == 16, "ExprNode should stay compact");
+
+// 所有表达式节点存放在一个连续的数组里, 节点之间用 32 位下标相互引用
+// 子节点总是先于父节点创建, 所以下标更小
+class ExprPool {
+ public:
+  ExprId Number(int32_t value) {
+    ExprNode node = NewNode(ExprKind::NUMBER, ExprOp::NONE);
+    node.number = value;
+    // 字面量不需要再折叠
+    node.fold_state = FoldState::CONST;
+    node.fold_value = value;
+    return Push(node);
+  }
+  ExprId LVal(SymbolId symbol) {
+    ExprNode node = NewNode(ExprKind::LVAL, ExprOp::NONE);
+    node.symbol = symbol;
+    return Push(node);
+  }
+  ExprId Unary(ExprOp op, ExprId operand) {
+    ExprNode node = NewNode(ExprKind::UNARY, op);
+    node.lhs = operand;
+    return Push(node);
+  }
+  ExprId Binary(ExprOp op, ExprId lhs, ExprId rhs) {
+    ExprNode node = NewNode(ExprKind::BINARY, op);
+    node.lhs = lhs;
+    node.rhs = rhs;
+    return Push(node);
+  }
+
+  ExprNode& operator[](ExprId id) { return nodes_[id]; }
+  const ExprNode& operator[](ExprId id) const { return nodes_[id]; }
+  size_t Size() const { return nodes_.size(); }
+  // 删除所有节点, 保留已分配的容量
+  void Clear() { nodes_.clear(); }
+
+ private:
+  static ExprNode NewNode(ExprKind kind, ExprOp op) {
+    ExprNode node;
+    node.kind = kind;
+    node.op = op;
+    node.fold_state = FoldState::UNKNOWN;
+    node.reg_need = 0;
+    node.lhs = kNoExpr;
+    node.rhs = kNoExpr;
+    node.fold_value = 0;
+    return node;
+  }
+  ExprId Push(const ExprNode &node) {
+    nodes_.push_back(node);
+    return nodes_.size() - 1;
+  }
+
+  std::vector<ExprNode> nodes_;
+};
+
+#endif
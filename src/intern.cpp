@@ -0,0 +1,51 @@
+#include <algorithm>
+#include <cstring>
+#include "intern.hpp"
+
+static uint32_t HashString(const char *str, size_t len) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i ++) {
+    hash ^= (unsigned char)str[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+StringInterner::StringInterner() : slots_(64, kEmpty) {}
+
+SymbolId StringInterner::Intern(const char *str, size_t len) {
+  uint32_t hash = HashString(str, len);
+  size_t mask = slots_.size() - 1;
+  for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+    uint32_t id = slots_[i];
+    if (id == kEmpty) {
+      id = entries_.size();
+      entries_.push_back({names_.CopyString(str, len), (uint32_t)len, hash});
+      slots_[i] = id;
+      // 装载因子超过 1/2 时扩容
+      if (entries_.size() * 2 > slots_.size()) Grow();
+      return id;
+    }
+    const Entry &entry = entries_[id];
+    if (entry.hash == hash && entry.len == len && memcmp(entry.str, str, len) == 0) {
+      return id;
+    }
+  }
+}
+
+void StringInterner::Clear() {
+  names_.Reset();
+  entries_.clear();
+  std::fill(slots_.begin(), slots_.end(), kEmpty);
+}
+
+void StringInterner::Grow() {
+  slots_.assign(slots_.size() * 2, kEmpty);
+  size_t mask = slots_.size() - 1;
+  for (uint32_t id = 0; id < entries_.size(); id ++) {
+    size_t i = entries_[id].hash & mask;
+    while (slots_[i] != kEmpty) i = (i + 1) & mask;
+    slots_[i] = id;
+  }
+}
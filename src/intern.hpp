@@ -0,0 +1,43 @@
+#ifndef __INTERN_HPP__
+#define __INTERN_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "arena.hpp"
+
+// 标识符驻留后的编号, 从 0 开始连续分配, 可以直接作为数组下标
+using SymbolId = uint32_t;
+
+// 字符串驻留表, 由 lexer 填充
+// 同一个标识符只保存一份, 之后只需要比较/索引 SymbolId
+class StringInterner {
+ public:
+  StringInterner();
+  StringInterner(const StringInterner&) = delete;
+  StringInterner& operator=(const StringInterner&) = delete;
+
+  SymbolId Intern(const char *str, size_t len);
+  // 清空所有标识符, 保留哈希表和名字所占的内存供下次编译使用
+  void Clear();
+  // 返回以 '\0' 结尾的名字, 在 interner 析构前一直有效
+  const char* Name(SymbolId id) const { return entries_[id].str; }
+  size_t Size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    const char *str;
+    uint32_t len;
+    uint32_t hash;
+  };
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+
+  void Grow();
+
+  Arena names_;
+  std::vector<Entry> entries_;
+  // 开放寻址的哈希表, 槽里存的是 entries_ 的下标
+  std::vector<uint32_t> slots_;
+};
+
+#endif
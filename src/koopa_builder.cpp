@@ -0,0 +1,211 @@
+#include <cassert>
+#include "koopa_builder.hpp"
+#include "trace.hpp"
+
+static const koopa_raw_type_kind_t kInt32Type = {KOOPA_RTT_INT32, {}};
+static const koopa_raw_type_kind_t kUnitType = {KOOPA_RTT_UNIT, {}};
+static const koopa_raw_type_kind_t kInt32PtrType = [] {
+  koopa_raw_type_kind_t ty = {KOOPA_RTT_POINTER, {}};
+  ty.data.pointer.base = &kInt32Type;
+  return ty;
+}();
+
+static koopa_raw_slice_t EmptySlice(koopa_raw_slice_item_kind_t kind) {
+  koopa_raw_slice_t slice;
+  slice.buffer = nullptr;
+  slice.len = 0;
+  slice.kind = kind;
+  return slice;
+}
+
+koopa_raw_type_t KoopaBuilder::Int32Type() {
+  return &kInt32Type;
+}
+
+koopa_raw_type_t KoopaBuilder::UnitType() {
+  return &kUnitType;
+}
+
+koopa_raw_type_t KoopaBuilder::Int32PtrType() {
+  return &kInt32PtrType;
+}
+
+KoopaBuilder::KoopaBuilder() {
+  funcs_list_ = NewSliceStorage();
+}
+
+std::vector<const void*>* KoopaBuilder::NewSliceStorage() {
+  slices_.emplace_back();
+  return &slices_.back();
+}
+
+void KoopaBuilder::FillSlice(koopa_raw_slice_t& slice, std::vector<const void*>* items,
+                             koopa_raw_slice_item_kind_t kind) {
+  slice.buffer = items->empty() ? nullptr : items->data();
+  slice.len = items->size();
+  slice.kind = kind;
+}
+
+koopa_raw_function_data_t* KoopaBuilder::NewFunction(const std::string& name,
+                                                     koopa_raw_type_t ret_ty) {
+  TRACE(IRGEN, 1, "function " << name);
+  types_.emplace_back();
+  koopa_raw_type_kind_t& func_ty = types_.back();
+  func_ty.tag = KOOPA_RTT_FUNCTION;
+  func_ty.data.function.params = EmptySlice(KOOPA_RSIK_TYPE);
+  func_ty.data.function.ret = ret_ty;
+
+  names_.push_back(name);
+  funcs_.emplace_back();
+  koopa_raw_function_data_t* func = &funcs_.back();
+  func->ty = &func_ty;
+  func->name = names_.back().c_str();
+  func->params = EmptySlice(KOOPA_RSIK_VALUE);
+  func->bbs = EmptySlice(KOOPA_RSIK_BASIC_BLOCK);
+  func_bbs_.push_back(NewSliceStorage());
+  funcs_list_->push_back(func);
+  bb_names_.clear();
+  entry_allocs_ = 0;
+  return func;
+}
+
+koopa_raw_basic_block_data_t* KoopaBuilder::NewBasicBlock(const std::string& name) {
+  koopa_raw_basic_block_data_t* bb = CreateBasicBlock(name);
+  InsertBlock(bb);
+  return bb;
+}
+
+koopa_raw_basic_block_data_t* KoopaBuilder::CreateBasicBlock(const std::string& name) {
+  assert(!func_bbs_.empty());
+  int count = bb_names_[name] ++;
+  names_.push_back(count ? name + "_" + std::to_string(count) : name);
+  TRACE(IRGEN, 1, "basic block " << names_.back());
+  bbs_.emplace_back();
+  koopa_raw_basic_block_data_t* bb = &bbs_.back();
+  bb->name = names_.back().c_str();
+  bb->params = EmptySlice(KOOPA_RSIK_VALUE);
+  bb->used_by = EmptySlice(KOOPA_RSIK_VALUE);
+  bb->insts = EmptySlice(KOOPA_RSIK_VALUE);
+  bb_insts_.push_back(NewSliceStorage());
+  insts_of_bb_[bb] = bb_insts_.back();
+  return bb;
+}
+
+void KoopaBuilder::InsertBlock(koopa_raw_basic_block_data_t* bb) {
+  assert(!func_bbs_.empty());
+  func_bbs_.back()->push_back(bb);
+}
+
+void KoopaBuilder::SetInsertPoint(koopa_raw_basic_block_data_t* bb) {
+  assert(insts_of_bb_.count(bb));
+  cur_insts_ = insts_of_bb_[bb];
+}
+
+bool KoopaBuilder::IsTerminated() const {
+  if (cur_insts_ == nullptr || cur_insts_->empty()) return false;
+  auto tag = reinterpret_cast<koopa_raw_value_t>(cur_insts_->back())->kind.tag;
+  return tag == KOOPA_RVT_RETURN || tag == KOOPA_RVT_BRANCH || tag == KOOPA_RVT_JUMP;
+}
+
+koopa_raw_value_data_t* KoopaBuilder::NewValue(koopa_raw_type_t ty) {
+  values_.emplace_back();
+  koopa_raw_value_data_t* value = &values_.back();
+  value->ty = ty;
+  value->name = nullptr;
+  value->used_by = EmptySlice(KOOPA_RSIK_VALUE);
+  return value;
+}
+
+koopa_raw_value_t KoopaBuilder::Append(koopa_raw_value_data_t* value) {
+  assert(cur_insts_);
+  cur_insts_->push_back(value);
+  return value;
+}
+
+koopa_raw_value_t KoopaBuilder::NewInteger(int32_t value) {
+  koopa_raw_value_data_t* ret = NewValue(Int32Type());
+  ret->kind.tag = KOOPA_RVT_INTEGER;
+  ret->kind.data.integer.value = value;
+  return ret;
+}
+
+koopa_raw_value_t KoopaBuilder::NewBinary(koopa_raw_binary_op_t op,
+                                          koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+  TRACE(IRGEN, 2, "binary op " << op);
+  koopa_raw_value_data_t* ret = NewValue(Int32Type());
+  ret->kind.tag = KOOPA_RVT_BINARY;
+  ret->kind.data.binary.op = op;
+  ret->kind.data.binary.lhs = lhs;
+  ret->kind.data.binary.rhs = rhs;
+  return Append(ret);
+}
+
+koopa_raw_value_t KoopaBuilder::NewReturn(koopa_raw_value_t value) {
+  koopa_raw_value_data_t* ret = NewValue(UnitType());
+  ret->kind.tag = KOOPA_RVT_RETURN;
+  ret->kind.data.ret.value = value;
+  return Append(ret);
+}
+
+koopa_raw_value_t KoopaBuilder::NewAlloc(koopa_raw_type_t base_ty) {
+  assert(base_ty == Int32Type());
+  TRACE(IRGEN, 2, "alloc");
+  koopa_raw_value_data_t* ret = NewValue(Int32PtrType());
+  ret->kind.tag = KOOPA_RVT_ALLOC;
+  auto entry = reinterpret_cast<koopa_raw_basic_block_t>(func_bbs_.back()->front());
+  std::vector<const void*>* insts = insts_of_bb_[entry];
+  insts->insert(insts->begin() + entry_allocs_ ++, ret);
+  return ret;
+}
+
+koopa_raw_value_t KoopaBuilder::NewLoad(koopa_raw_value_t src) {
+  TRACE(IRGEN, 2, "load");
+  koopa_raw_value_data_t* ret = NewValue(src->ty->data.pointer.base);
+  ret->kind.tag = KOOPA_RVT_LOAD;
+  ret->kind.data.load.src = src;
+  return Append(ret);
+}
+
+koopa_raw_value_t KoopaBuilder::NewStore(koopa_raw_value_t value, koopa_raw_value_t dest) {
+  TRACE(IRGEN, 2, "store");
+  koopa_raw_value_data_t* ret = NewValue(UnitType());
+  ret->kind.tag = KOOPA_RVT_STORE;
+  ret->kind.data.store.value = value;
+  ret->kind.data.store.dest = dest;
+  return Append(ret);
+}
+
+koopa_raw_value_t KoopaBuilder::NewBranch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb,
+                                          koopa_raw_basic_block_t false_bb) {
+  TRACE(IRGEN, 2, "br " << true_bb->name << ", " << false_bb->name);
+  koopa_raw_value_data_t* ret = NewValue(UnitType());
+  ret->kind.tag = KOOPA_RVT_BRANCH;
+  ret->kind.data.branch.cond = cond;
+  ret->kind.data.branch.true_bb = true_bb;
+  ret->kind.data.branch.false_bb = false_bb;
+  ret->kind.data.branch.true_args = EmptySlice(KOOPA_RSIK_VALUE);
+  ret->kind.data.branch.false_args = EmptySlice(KOOPA_RSIK_VALUE);
+  return Append(ret);
+}
+
+koopa_raw_value_t KoopaBuilder::NewJump(koopa_raw_basic_block_t target) {
+  TRACE(IRGEN, 2, "jump " << target->name);
+  koopa_raw_value_data_t* ret = NewValue(UnitType());
+  ret->kind.tag = KOOPA_RVT_JUMP;
+  ret->kind.data.jump.target = target;
+  ret->kind.data.jump.args = EmptySlice(KOOPA_RSIK_VALUE);
+  return Append(ret);
+}
+
+koopa_raw_program_t KoopaBuilder::Finish() {
+  for (size_t i = 0; i < funcs_.size(); i ++) {
+    FillSlice(funcs_[i].bbs, func_bbs_[i], KOOPA_RSIK_BASIC_BLOCK);
+  }
+  for (size_t i = 0; i < bbs_.size(); i ++) {
+    FillSlice(bbs_[i].insts, bb_insts_[i], KOOPA_RSIK_VALUE);
+  }
+  koopa_raw_program_t program;
+  program.values = EmptySlice(KOOPA_RSIK_VALUE);
+  FillSlice(program.funcs, funcs_list_, KOOPA_RSIK_FUNCTION);
+  return program;
+}
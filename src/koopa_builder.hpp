@@ -0,0 +1,81 @@
+#ifndef __KOOPA_BUILDER_HPP__
+#define __KOOPA_BUILDER_HPP__
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "koopa.h"
+
+// 直接在内存中构建 Koopa raw program, 供 Visit(...) 使用
+// 不再经过 "生成文本 -> koopa_parse_from_string -> koopa_build_raw_program" 的往返
+// 所有节点都由 builder 持有, builder 析构时一并释放
+class KoopaBuilder {
+ public:
+  KoopaBuilder();
+  KoopaBuilder(const KoopaBuilder&) = delete;
+  KoopaBuilder& operator=(const KoopaBuilder&) = delete;
+
+  // 创建函数, 之后的基本块都会挂在这个函数下
+  koopa_raw_function_data_t* NewFunction(const std::string& name, koopa_raw_type_t ret_ty);
+  // 在当前函数中创建基本块并放到函数末尾, name 需要带 '%' 前缀
+  // 同一函数中重名时自动加上 _1, _2, ... 后缀
+  koopa_raw_basic_block_data_t* NewBasicBlock(const std::string& name);
+  // 只创建基本块, 之后再用 InsertBlock 决定它在函数中的位置
+  // 用于先生成跳向某个块的指令, 等中间的块都生成完再放置目标块
+  koopa_raw_basic_block_data_t* CreateBasicBlock(const std::string& name);
+  void InsertBlock(koopa_raw_basic_block_data_t* bb);
+  // 之后创建的指令都会追加到 bb 的末尾
+  void SetInsertPoint(koopa_raw_basic_block_data_t* bb);
+  // 当前基本块是否已经以 ret/br/jump 结尾
+  bool IsTerminated() const;
+
+  // 常量不属于任何基本块
+  koopa_raw_value_t NewInteger(int32_t value);
+  koopa_raw_value_t NewBinary(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs);
+  koopa_raw_value_t NewReturn(koopa_raw_value_t value);
+  // alloc 总是放在当前函数入口块的开头
+  koopa_raw_value_t NewAlloc(koopa_raw_type_t base_ty);
+  koopa_raw_value_t NewLoad(koopa_raw_value_t src);
+  koopa_raw_value_t NewStore(koopa_raw_value_t value, koopa_raw_value_t dest);
+  koopa_raw_value_t NewBranch(koopa_raw_value_t cond, koopa_raw_basic_block_t true_bb,
+                              koopa_raw_basic_block_t false_bb);
+  koopa_raw_value_t NewJump(koopa_raw_basic_block_t target);
+
+  // 固定所有 slice, 返回完整的 raw program
+  // 返回值中的指针在 builder 析构前一直有效
+  koopa_raw_program_t Finish();
+
+  static koopa_raw_type_t Int32Type();
+  static koopa_raw_type_t UnitType();
+  static koopa_raw_type_t Int32PtrType();
+
+ private:
+  koopa_raw_value_data_t* NewValue(koopa_raw_type_t ty);
+  koopa_raw_value_t Append(koopa_raw_value_data_t* value);
+  std::vector<const void*>* NewSliceStorage();
+  static void FillSlice(koopa_raw_slice_t& slice, std::vector<const void*>* items,
+                        koopa_raw_slice_item_kind_t kind);
+
+  // deque 保证扩容时已有元素的地址不变
+  std::deque<koopa_raw_value_data_t> values_;
+  std::deque<koopa_raw_basic_block_data_t> bbs_;
+  std::deque<koopa_raw_function_data_t> funcs_;
+  std::deque<koopa_raw_type_kind_t> types_;
+  std::deque<std::string> names_;
+  std::deque<std::vector<const void*>> slices_;
+
+  // 每个函数/基本块对应的元素列表, 在 Finish 时写回 slice
+  std::vector<std::vector<const void*>*> func_bbs_;
+  std::vector<std::vector<const void*>*> bb_insts_;
+  std::unordered_map<const koopa_raw_basic_block_data_t*, std::vector<const void*>*> insts_of_bb_;
+  std::vector<const void*>* funcs_list_;
+  std::vector<const void*>* cur_insts_ = nullptr;
+  // 当前函数的基本块名字 -> 已使用次数
+  std::unordered_map<std::string, int> bb_names_;
+  // 当前函数入口块中已有的 alloc 数, 新的 alloc 插在它们后面
+  size_t entry_allocs_ = 0;
+};
+
+#endif
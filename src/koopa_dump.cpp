@@ -0,0 +1,156 @@
+#include <cassert>
+#include <unordered_map>
+#include "koopa_dump.hpp"
+
+namespace {
+
+// 为没有名字的指令分配 %0, %1, ... 这样的临时名字
+class KoopaPrinter {
+ public:
+  explicit KoopaPrinter(OutputSink &out) : out_(out) {}
+
+  void Dump(const koopa_raw_program_t &program) {
+    for (size_t i = 0; i < program.funcs.len; i ++) {
+      DumpFunction(reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]));
+    }
+  }
+
+ private:
+  OutputSink &out_;
+  std::unordered_map<koopa_raw_value_t, int> value_ids_;
+  int next_id_ = 0;
+
+  static const char* TypeName(koopa_raw_type_t ty) {
+    switch (ty->tag) {
+      case KOOPA_RTT_INT32:
+        return "i32";
+      case KOOPA_RTT_UNIT:
+        return "unit";
+      case KOOPA_RTT_POINTER:
+        assert(ty->data.pointer.base->tag == KOOPA_RTT_INT32);
+        return "*i32";
+      default:
+        // 其他类型暂时遇不到
+        assert(false);
+    }
+    return "";
+  }
+
+  void DumpFunction(koopa_raw_function_t func) {
+    out_ << "fun " << func->name << "()";
+    koopa_raw_type_t ret_ty = func->ty->data.function.ret;
+    if (ret_ty->tag != KOOPA_RTT_UNIT) {
+      out_ << ": " << TypeName(ret_ty);
+    }
+    out_ << " {\n";
+    for (size_t i = 0; i < func->bbs.len; i ++) {
+      auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+      // 基本块之间空一行, 与 Koopa 官方的输出格式一致
+      if (i) out_ << '\n';
+      out_ << bb->name << ":\n";
+      for (size_t j = 0; j < bb->insts.len; j ++) {
+        DumpInst(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]));
+      }
+    }
+    out_ << "}\n";
+  }
+
+  // 指令的操作数: 整数直接输出, 其他值输出它的名字
+  void Operand(koopa_raw_value_t value) {
+    if (value->kind.tag == KOOPA_RVT_INTEGER) {
+      out_ << value->kind.data.integer.value;
+    } else if (value->name) {
+      out_ << value->name;
+    } else {
+      assert(value_ids_.count(value));
+      out_ << '%' << value_ids_[value];
+    }
+  }
+
+  void Define(koopa_raw_value_t value) {
+    if (value->name) {
+      out_ << value->name;
+      return;
+    }
+    value_ids_[value] = next_id_;
+    out_ << '%' << next_id_ ++;
+  }
+
+  static const char* BinaryOpName(koopa_raw_binary_op_t op) {
+    switch (op) {
+      case KOOPA_RBO_NOT_EQ: return "ne";
+      case KOOPA_RBO_EQ: return "eq";
+      case KOOPA_RBO_GT: return "gt";
+      case KOOPA_RBO_LT: return "lt";
+      case KOOPA_RBO_GE: return "ge";
+      case KOOPA_RBO_LE: return "le";
+      case KOOPA_RBO_ADD: return "add";
+      case KOOPA_RBO_SUB: return "sub";
+      case KOOPA_RBO_MUL: return "mul";
+      case KOOPA_RBO_DIV: return "div";
+      case KOOPA_RBO_MOD: return "mod";
+      case KOOPA_RBO_AND: return "and";
+      case KOOPA_RBO_OR: return "or";
+      case KOOPA_RBO_XOR: return "xor";
+      case KOOPA_RBO_SHL: return "shl";
+      case KOOPA_RBO_SHR: return "shr";
+      case KOOPA_RBO_SAR: return "sar";
+    }
+    return "";
+  }
+
+  void DumpInst(koopa_raw_value_t value) {
+    out_ << "  ";
+    const auto &kind = value->kind;
+    switch (kind.tag) {
+      case KOOPA_RVT_BINARY:
+        Define(value);
+        out_ << " = " << BinaryOpName(kind.data.binary.op) << ' ';
+        Operand(kind.data.binary.lhs);
+        out_ << ", ";
+        Operand(kind.data.binary.rhs);
+        break;
+      case KOOPA_RVT_ALLOC:
+        Define(value);
+        out_ << " = alloc " << TypeName(value->ty->data.pointer.base);
+        break;
+      case KOOPA_RVT_LOAD:
+        Define(value);
+        out_ << " = load ";
+        Operand(kind.data.load.src);
+        break;
+      case KOOPA_RVT_STORE:
+        out_ << "store ";
+        Operand(kind.data.store.value);
+        out_ << ", ";
+        Operand(kind.data.store.dest);
+        break;
+      case KOOPA_RVT_BRANCH:
+        out_ << "br ";
+        Operand(kind.data.branch.cond);
+        out_ << ", " << kind.data.branch.true_bb->name << ", " << kind.data.branch.false_bb->name;
+        break;
+      case KOOPA_RVT_JUMP:
+        out_ << "jump " << kind.data.jump.target->name;
+        break;
+      case KOOPA_RVT_RETURN:
+        out_ << "ret";
+        if (kind.data.ret.value) {
+          out_ << ' ';
+          Operand(kind.data.ret.value);
+        }
+        break;
+      default:
+        // 其他类型暂时遇不到
+        assert(false);
+    }
+    out_ << '\n';
+  }
+};
+
+}  // namespace
+
+void DumpKoopa(const koopa_raw_program_t &program, OutputSink &out) {
+  KoopaPrinter printer(out);
+  printer.Dump(program);
+}
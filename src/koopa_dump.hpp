@@ -0,0 +1,10 @@
+#ifndef __KOOPA_DUMP_HPP__
+#define __KOOPA_DUMP_HPP__
+
+#include "koopa.h"
+#include "output.hpp"
+
+// 把内存中的 raw program 输出成 Koopa IR 文本, 仅用于 -koopa 模式
+void DumpKoopa(const koopa_raw_program_t &program, OutputSink &out);
+
+#endif
@@ -1,55 +1,218 @@
 #include <cassert>
+#include <chrono>
 #include <cstdio>
-#include <iostream>
+#include <cstring>
 #include <fstream>
+#include <iostream>
 #include <memory>
+#include <set>
 #include <string>
-#include "ast.hpp"
-#include "visit.hpp"
+#include <vector>
+#include "cache.hpp"
+#include "driver.hpp"
+#include "pass_timer.hpp"
+#include "schedule.hpp"
+#include "server.hpp"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 
 using namespace std;
 
-// 声明 lexer 的输入, 以及 parser 函数
-// 为什么不引用 sysy.tab.hpp 呢? 因为首先里面没有 yyin 的定义
-// 其次, 因为这个文件不是我们自己写的, 而是被 Bison 生成出来的
-// 你的代码编辑器/IDE 很可能找不到这个文件, 然后会给你报错 (虽然编译不会出错)
-// 看起来会很烦人, 于是干脆采用这种看起来 dirty 但实际很有效的手段
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST> &ast);
+// 批量模式下输入文件对应的输出路径: 输出目录/文件名去掉扩展名 + .koopa, .S, .o 或 .sim
+static std::string BatchOutputPath(const std::string &dir, const std::string &mode,
+                                   const std::string &input) {
+  size_t slash = input.find_last_of('/');
+  std::string stem = slash == std::string::npos ? input : input.substr(slash + 1);
+  size_t dot = stem.find_last_of('.');
+  if (dot != std::string::npos && dot != 0) stem = stem.substr(0, dot);
+  const char *extension = mode == "-koopa" ? ".koopa" : mode == "-elf" ? ".o" :
+                          mode == "-sim" ? ".sim" : ".S";
+  return dir + "/" + stem + extension;
+}
+
+// 批量模式: 在线程池中并行编译所有输入, 每个文件的输出与单文件模式完全相同
+static int RunBatch(const CompileOptions &options, const std::string &output_dir,
+                    const std::vector<std::string> &inputs, size_t jobs,
+                    const std::string &time_passes) {
+  std::vector<std::string> outputs;
+  std::set<std::string> seen;
+  for (const auto &input : inputs) {
+    outputs.push_back(BatchOutputPath(output_dir, options.mode, input));
+    if (!seen.insert(outputs.back()).second) {
+      cerr << "duplicate output file: " << outputs.back() << " (from " << input << ")" << endl;
+      return 1;
+    }
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::string> errors(inputs.size());
+  std::vector<char> ok(inputs.size());
+  size_t threads;
+  {
+    ThreadPool pool(jobs);
+    threads = pool.Size();
+    for (size_t i = 0; i < inputs.size(); i ++) {
+      pool.Submit([&, i] {
+        // 批量模式下各阶段的统计没有意义 (分配计数是全进程的), 每个文件用自己的计时器
+        PassTimer timer;
+        ok[i] = CompileFile(options, inputs[i].c_str(), outputs[i].c_str(), timer, errors[i]);
+      });
+    }
+    pool.Wait();
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
 
+  // 按输入顺序报告错误, 输出与线程调度无关
+  size_t failed = 0;
+  for (size_t i = 0; i < inputs.size(); i ++) {
+    if (!ok[i]) {
+      cerr << errors[i] << endl;
+      failed ++;
+    }
+  }
+  unsigned long long hits = options.cache ? options.cache->Hits() : 0;
+  if (time_passes == "text") {
+    fprintf(stderr, "batch: %zu files, %zu failed, %zu threads, %.3f ms",
+            inputs.size(), failed, threads, seconds * 1000);
+    if (options.cache) fprintf(stderr, ", %llu cache hits", hits);
+    fprintf(stderr, "\n");
+  } else if (time_passes == "json") {
+    fprintf(stderr, "{\"files\": %zu, \"failed\": %zu, \"threads\": %zu, \"seconds\": %.6f",
+            inputs.size(), failed, threads, seconds);
+    if (options.cache) fprintf(stderr, ", \"cache_hits\": %llu", hits);
+    fprintf(stderr, "}\n");
+  }
+  return failed ? 1 : 0;
+}
 
-// 访问对应类型指令的函数定义略
-// 视需求自行实现
-// ...
+// 读取列表文件, 每行一个输入路径, 忽略空行
+static bool ReadInputList(const char *path, std::vector<std::string> &inputs) {
+  std::ifstream list(path);
+  if (!list) return false;
+  std::string line;
+  while (std::getline(list, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (!line.empty()) inputs.push_back(line);
+  }
+  return true;
+}
 
 int main(int argc, const char *argv[]) {
   // 解析命令行参数. 测试脚本/评测平台要求你的编译器能接收如下参数:
-  // compiler 模式 输入文件 -o 输出文件
-  assert(argc == 5);
-  auto mode = argv[1];
-  auto input = argv[2];
-  auto output = argv[4];
-
-  std::ofstream outf(output);
-
-  // 打开输入文件, 并且指定 lexer 在解析的时候读取这个文件
-  yyin = fopen(input, "r");
-  assert(yyin);
-
-  // 调用 parser 函数, parser 函数会进一步调用 lexer 解析输入文件的
-  unique_ptr<BaseAST> ast;
-  auto retxx = yyparse(ast);
-  assert(!retxx);
-  // dump AST
-  std::string result = ast->Dump();
-  cout << result << endl;
-  if (mode == std::string("-koopa")) {
-    outf << result << std::endl;
-  } else if (mode == std::string("-riscv")) {
-   std::string ret_asm = convert_to_asm(result);
-    outf << ret_asm << std::endl;
-    free_koopa_program();
-  }
- 
+  // compiler 模式 输入文件 -o 输出文件 [选项...]
+  // 批量模式:
+  // compiler 模式 -batch -o 输出目录 [选项...] 输入文件...
+  // 以 '@' 开头的参数表示一个列表文件, 其中每行是一个输入文件
+  // 编译服务 (协议见 server.hpp), 不带路径时使用 stdin/stdout:
+  // compiler -serve[=socket路径] [选项...]
+  bool serve = argc >= 2 && strncmp(argv[1], "-serve", 6) == 0 &&
+               (argv[1][6] == '\0' || argv[1][6] == '=');
+  assert(serve || argc >= 5);
+  CompileOptions options;
+  const char *input = nullptr, *output = nullptr;
+  bool batch = false;
+  if (!serve) {
+    options.mode = argv[1];
+    input = argv[2];
+    output = argv[4];
+    batch = strcmp(input, "-batch") == 0;
+  }
+  std::vector<std::string> inputs;
+  // 批量模式的线程数, 0 表示使用硬件线程数
+  size_t jobs = 0;
+  // -cache-dir=目录 启用编译结果缓存, -cache-size=N 是缓存的大小上限, 单位 MB
+  std::string cache_dir;
+  uint64_t cache_size = CompileCache::kDefaultMaxBytes;
+  // -time-passes 或 -time-passes=text 输出可读的表格, -time-passes=json 输出 JSON, 都写到 stderr
+  std::string time_passes;
+  for (int i = serve ? 2 : 5; i < argc; i ++) {
+    std::string option = argv[i];
+    if (option == "-time-passes") {
+      time_passes = "text";
+    } else if (option.compare(0, 13, "-time-passes=") == 0) {
+      time_passes = option.substr(13);
+      if (time_passes != "text" && time_passes != "json") {
+        cerr << "invalid time-passes format: " << time_passes << endl;
+        return 1;
+      }
+    } else if (option == "-O0" || option == "-O1") {
+      // 优化级别, -O0 (默认) 不做任何优化, -O1 运行 OptimizeProgram
+      options.opt_level = option[2] - '0';
+    } else if (option == "-fno-fold") {
+      options.fold = false;
+    } else if (option.compare(0, 17, "-peephole-window=") == 0) {
+      options.peephole_window = atoi(argv[i] + 17);
+      if (options.peephole_window < 0) {
+        cerr << "invalid peephole window: " << option << endl;
+        return 1;
+      }
+    } else if (option.compare(0, 13, "-sched-model=") == 0) {
+      options.sched_model = option.substr(13);
+      if (options.sched_model != "none" && !FindSchedModel(options.sched_model)) {
+        cerr << "invalid scheduling model: " << options.sched_model << endl;
+        return 1;
+      }
+    } else if (option.compare(0, 11, "-sim-model=") == 0) {
+      options.sim_model = option.substr(11);
+      if (!FindSchedModel(options.sim_model)) {
+        cerr << "invalid simulation model: " << options.sim_model << endl;
+        return 1;
+      }
+    } else if (option.compare(0, 11, "-cache-dir=") == 0) {
+      cache_dir = option.substr(11);
+    } else if (option.compare(0, 12, "-cache-size=") == 0) {
+      cache_size = strtoull(argv[i] + 12, nullptr, 10) << 20;
+    } else if (option.compare(0, 7, "-trace=") == 0) {
+      // 调试输出的开关, 例如 -trace=lexer,isel:2
+      if (!ParseTraceOption(argv[i] + 7)) {
+        cerr << "invalid trace option: " << option << endl;
+        return 1;
+      }
+    } else if (batch && option.compare(0, 6, "-jobs=") == 0) {
+      jobs = strtoul(argv[i] + 6, nullptr, 10);
+    } else if (batch && option[0] == '@') {
+      if (!ReadInputList(argv[i] + 1, inputs)) {
+        cerr << "cannot read input list: " << option.substr(1) << endl;
+        return 1;
+      }
+    } else if (batch && option[0] != '-') {
+      inputs.push_back(option);
+    } else {
+      cerr << "unknown option: " << option << endl;
+      return 1;
+    }
+  }
+
+  std::unique_ptr<CompileCache> cache;
+  if (!cache_dir.empty()) {
+    cache.reset(new CompileCache(cache_dir, cache_size));
+    std::string error;
+    if (!cache->Init(error)) {
+      cerr << error << endl;
+      return 1;
+    }
+    options.cache = cache.get();
+  }
+
+  if (serve) {
+    return RunServer(options, argv[1][6] == '=' ? argv[1] + 7 : "", time_passes);
+  }
+  if (batch) {
+    return RunBatch(options, output, inputs, jobs, time_passes);
+  }
+
+  PassTimer timer;
+  std::string error;
+  if (!CompileFile(options, input, output, timer, error)) {
+    cerr << error << endl;
+    return 1;
+  }
+
+  if (time_passes == "text") {
+    timer.Report(stderr);
+  } else if (time_passes == "json") {
+    timer.ReportJson(stderr);
+  }
+
   return 0;
 }
@@ -0,0 +1,278 @@
+#include <cassert>
+#include <unordered_map>
+#include "mir.hpp"
+
+static const MachineOpInfo kMachineOpInfo[] = {
+  {"add", MachineFormat::R},
+  {"sub", MachineFormat::R},
+  {"mul", MachineFormat::R},
+  {"mulh", MachineFormat::R},
+  {"div", MachineFormat::R},
+  {"rem", MachineFormat::R},
+  {"and", MachineFormat::R},
+  {"or", MachineFormat::R},
+  {"xor", MachineFormat::R},
+  {"sll", MachineFormat::R},
+  {"srl", MachineFormat::R},
+  {"sra", MachineFormat::R},
+  {"slt", MachineFormat::R},
+  {"sgt", MachineFormat::R},
+  {"addi", MachineFormat::I},
+  {"andi", MachineFormat::I},
+  {"ori", MachineFormat::I},
+  {"xori", MachineFormat::I},
+  {"slli", MachineFormat::I},
+  {"srli", MachineFormat::I},
+  {"srai", MachineFormat::I},
+  {"slti", MachineFormat::I},
+  {"lui", MachineFormat::U},
+  {"li", MachineFormat::U},
+  {"mv", MachineFormat::UNARY},
+  {"seqz", MachineFormat::UNARY},
+  {"snez", MachineFormat::UNARY},
+  {"lw", MachineFormat::LOAD},
+  {"sw", MachineFormat::STORE},
+  {"beqz", MachineFormat::BRANCH_Z},
+  {"bnez", MachineFormat::BRANCH_Z},
+  {"beq", MachineFormat::BRANCH},
+  {"bne", MachineFormat::BRANCH},
+  {"blt", MachineFormat::BRANCH},
+  {"bge", MachineFormat::BRANCH},
+  {"j", MachineFormat::JUMP},
+  {"ret", MachineFormat::RET},
+  {"", MachineFormat::LABEL},
+};
+static_assert(sizeof(kMachineOpInfo) / sizeof(kMachineOpInfo[0]) == (size_t)MachineOp::COUNT,
+              "every MachineOp needs an entry in kMachineOpInfo");
+
+const MachineOpInfo& GetMachineOpInfo(MachineOp op) {
+  return kMachineOpInfo[(int)op];
+}
+
+bool MachineInst::IsTerminator() const {
+  MachineFormat format = Info().format;
+  return format == MachineFormat::BRANCH_Z || format == MachineFormat::BRANCH ||
+         format == MachineFormat::JUMP || format == MachineFormat::RET;
+}
+
+bool MachineInst::HasSideEffects() const {
+  switch (Info().format) {
+    case MachineFormat::STORE:
+    case MachineFormat::BRANCH_Z:
+    case MachineFormat::BRANCH:
+    case MachineFormat::JUMP:
+    case MachineFormat::RET:
+    case MachineFormat::LABEL:
+      return true;
+    default:
+      // 栈帧的分配/释放
+      return rd == RV_SP;
+  }
+}
+
+int MachineInst::Def() const {
+  switch (Info().format) {
+    case MachineFormat::R:
+    case MachineFormat::I:
+    case MachineFormat::U:
+    case MachineFormat::UNARY:
+    case MachineFormat::LOAD:
+      return rd == RV_ZERO ? -1 : rd;
+    default:
+      return -1;
+  }
+}
+
+// 物理寄存器对应的位, 虚拟寄存器不在掩码中
+static uint32_t RegBit(int reg) {
+  return IsVirtualReg(reg) ? 0 : 1u << reg;
+}
+
+uint32_t MachineInst::Uses() const {
+  uint32_t uses = 0;
+  switch (Info().format) {
+    case MachineFormat::R:
+    case MachineFormat::STORE:
+    case MachineFormat::BRANCH:
+      uses = RegBit(rs1) | RegBit(rs2);
+      break;
+    case MachineFormat::I:
+    case MachineFormat::UNARY:
+    case MachineFormat::LOAD:
+    case MachineFormat::BRANCH_Z:
+      uses = RegBit(rs1);
+      break;
+    case MachineFormat::RET:
+      // 返回值, 以及调用者期望保持不变的寄存器
+      uses = (1u << RV_A0) | (1u << RV_SP) | (1u << RV_RA);
+      for (int reg = 0; reg < RV_REG_COUNT; reg ++) {
+        if (IsCalleeSaved(reg)) uses |= 1u << reg;
+      }
+      break;
+    default:
+      break;
+  }
+  return uses & ~1u;
+}
+
+int *MachineInst::DefOperand() {
+  return Def() >= 0 ? &rd : nullptr;
+}
+
+int MachineInst::UseOperands(int *regs[2]) {
+  switch (Info().format) {
+    case MachineFormat::R:
+    case MachineFormat::STORE:
+    case MachineFormat::BRANCH:
+      regs[0] = &rs1;
+      regs[1] = &rs2;
+      return 2;
+    case MachineFormat::I:
+    case MachineFormat::UNARY:
+    case MachineFormat::LOAD:
+    case MachineFormat::BRANCH_Z:
+      regs[0] = &rs1;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+MachineCFG BuildMachineCFG(const MachineFunction &func) {
+  const auto &insts = func.insts;
+  size_t n = insts.size();
+  MachineCFG cfg;
+  std::unordered_map<koopa_raw_basic_block_t, size_t> block_of_label;
+  for (size_t i = 0; i < n; i ++) {
+    bool after_terminator = i > 0 && insts[i - 1].IsTerminator();
+    if (i == 0 || insts[i].IsLabel() || after_terminator) {
+      if (cfg.starts.empty() || cfg.starts.back() != i) cfg.starts.push_back(i);
+    }
+    if (insts[i].IsLabel()) block_of_label[insts[i].target] = cfg.starts.size() - 1;
+  }
+  size_t blocks = cfg.starts.size();
+  cfg.ends.resize(blocks);
+  cfg.succs.resize(blocks);
+  for (size_t b = 0; b < blocks; b ++) {
+    cfg.ends[b] = b + 1 < blocks ? cfg.starts[b + 1] : n;
+    const MachineInst &last = insts[cfg.ends[b] - 1];
+    bool falls_through = true;
+    switch (last.Info().format) {
+      case MachineFormat::JUMP:
+        falls_through = false;
+        // fall through
+      case MachineFormat::BRANCH_Z:
+      case MachineFormat::BRANCH:
+        assert(block_of_label.count(last.target));
+        cfg.succs[b].push_back(block_of_label[last.target]);
+        break;
+      case MachineFormat::RET:
+        falls_through = false;
+        break;
+      default:
+        break;
+    }
+    if (falls_through && b + 1 < blocks) cfg.succs[b].push_back(b + 1);
+  }
+  return cfg;
+}
+
+void EmitLoadImm(std::vector<MachineInst> &insts, int reg, int32_t value) {
+  if (FitsImm12(value)) {
+    insts.push_back(MachineInst::U(MachineOp::LI, reg, value));
+    return;
+  }
+  // addi 的立即数是有符号的, 低 12 位的最高位为 1 时高 20 位要多加 1
+  uint32_t hi = ((uint32_t)value + 0x800) >> 12;
+  int32_t lo = (int32_t)((uint32_t)value - (hi << 12));
+  insts.push_back(MachineInst::U(MachineOp::LUI, reg, (int32_t)(hi & 0xfffff)));
+  if (lo) insts.push_back(MachineInst::I(MachineOp::ADDI, reg, reg, lo));
+}
+
+void EmitStackLoad(std::vector<MachineInst> &insts, int reg, int offset, int tmp) {
+  if (FitsImm12(offset)) {
+    insts.push_back(MachineInst::Load(reg, RV_SP, offset));
+  } else {
+    EmitLoadImm(insts, tmp, offset);
+    insts.push_back(MachineInst::R(MachineOp::ADD, tmp, tmp, RV_SP));
+    insts.push_back(MachineInst::Load(reg, tmp, 0));
+  }
+}
+
+void EmitStackStore(std::vector<MachineInst> &insts, int reg, int offset, int tmp) {
+  if (FitsImm12(offset)) {
+    insts.push_back(MachineInst::Store(reg, RV_SP, offset));
+  } else {
+    EmitLoadImm(insts, tmp, offset);
+    insts.push_back(MachineInst::R(MachineOp::ADD, tmp, tmp, RV_SP));
+    insts.push_back(MachineInst::Store(reg, tmp, 0));
+  }
+}
+
+// 寄存器分配之前 (例如 -trace 输出) 虚拟寄存器打印成 %vN
+struct RegName {
+  int reg;
+};
+
+static OutputSink& operator<<(OutputSink &out, RegName name) {
+  if (IsVirtualReg(name.reg)) return out << "%v" << (int32_t)(name.reg - kFirstVirtualReg);
+  return out << RiscvRegName(name.reg);
+}
+
+static void PrintLabel(const MachineFunction &func, koopa_raw_basic_block_t bb, OutputSink &out) {
+  out << func.name << "_" << (bb->name + 1);
+}
+
+static void PrintInst(const MachineFunction &func, const MachineInst &inst, OutputSink &out) {
+  const MachineOpInfo &info = inst.Info();
+  if (info.format == MachineFormat::LABEL) {
+    PrintLabel(func, inst.target, out);
+    out << ":\n";
+    return;
+  }
+  out << "\t" << info.name;
+  switch (info.format) {
+    case MachineFormat::R:
+      out << " " << RegName{inst.rd} << ", " << RegName{inst.rs1} << ", "
+          << RegName{inst.rs2};
+      break;
+    case MachineFormat::I:
+      out << " " << RegName{inst.rd} << ", " << RegName{inst.rs1} << ", " << inst.imm;
+      break;
+    case MachineFormat::U:
+      out << " " << RegName{inst.rd} << ", " << inst.imm;
+      break;
+    case MachineFormat::UNARY:
+      out << " " << RegName{inst.rd} << ", " << RegName{inst.rs1};
+      break;
+    case MachineFormat::LOAD:
+      out << " " << RegName{inst.rd} << ", " << inst.imm << "(" << RegName{inst.rs1} << ")";
+      break;
+    case MachineFormat::STORE:
+      out << " " << RegName{inst.rs2} << ", " << inst.imm << "(" << RegName{inst.rs1} << ")";
+      break;
+    case MachineFormat::BRANCH_Z:
+      out << " " << RegName{inst.rs1} << ", ";
+      PrintLabel(func, inst.target, out);
+      break;
+    case MachineFormat::BRANCH:
+      out << " " << RegName{inst.rs1} << ", " << RegName{inst.rs2} << ", ";
+      PrintLabel(func, inst.target, out);
+      break;
+    case MachineFormat::JUMP:
+      out << " ";
+      PrintLabel(func, inst.target, out);
+      break;
+    case MachineFormat::RET:
+      break;
+    default:
+      assert(false);
+  }
+  out << "\n";
+}
+
+void PrintMachineFunction(const MachineFunction &func, OutputSink &out) {
+  out << "\t.globl " << func.name << "\n";
+  out << func.name << ":\n";
+  for (const auto &inst : func.insts) PrintInst(func, inst, out);
+}
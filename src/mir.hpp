@@ -0,0 +1,173 @@
+#ifndef __MIR_HPP__
+#define __MIR_HPP__
+
+#include <cstdint>
+#include <vector>
+#include "koopa.h"
+#include "output.hpp"
+#include "riscv.hpp"
+
+// 机器指令 (MIR): 指令选择的结果先放在列表里, 经过寄存器分配和窥孔优化等处理之后再统一输出成汇编文本
+
+// 寄存器操作数: 0 ~ 31 是物理寄存器 (RiscvReg), 从 kFirstVirtualReg 开始是指令选择时分配的虚拟寄存器,
+// 由寄存器分配改写成物理寄存器
+constexpr int kFirstVirtualReg = 32;
+
+inline bool IsVirtualReg(int reg) {
+  return reg >= kFirstVirtualReg;
+}
+enum class MachineOp {
+  // R 型: op rd, rs1, rs2
+  ADD, SUB, MUL, MULH, DIV, REM, AND, OR, XOR, SLL, SRL, SRA, SLT, SGT,
+  // I 型: op rd, rs1, imm
+  ADDI, ANDI, ORI, XORI, SLLI, SRLI, SRAI, SLTI,
+  // lui rd, imm / li rd, imm
+  LUI, LI,
+  // 伪指令 op rd, rs1
+  MV, SEQZ, SNEZ,
+  // lw rd, imm(rs1) / sw rs2, imm(rs1)
+  LW, SW,
+  // beqz/bnez rs1, target
+  BEQZ, BNEZ,
+  // op rs1, rs2, target
+  BEQ, BNE, BLT, BGE,
+  // j target
+  J,
+  RET,
+  // 基本块的标号 target:
+  LABEL,
+  COUNT
+};
+
+// 指令的汇编格式, 决定输出方式以及读写哪些寄存器
+enum class MachineFormat { R, I, U, UNARY, LOAD, STORE, BRANCH_Z, BRANCH, JUMP, RET, LABEL };
+
+struct MachineOpInfo {
+  const char *name;
+  MachineFormat format;
+};
+
+const MachineOpInfo& GetMachineOpInfo(MachineOp op);
+
+struct MachineInst {
+  MachineOp op;
+  int rd = RV_ZERO;
+  int rs1 = RV_ZERO;
+  int rs2 = RV_ZERO;
+  int32_t imm = 0;
+  // 跳转目标, 或者 LABEL 对应的基本块
+  koopa_raw_basic_block_t target = nullptr;
+
+  static MachineInst R(MachineOp op, int rd, int rs1, int rs2) {
+    MachineInst inst = {op};
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    inst.rs2 = rs2;
+    return inst;
+  }
+  static MachineInst I(MachineOp op, int rd, int rs1, int32_t imm) {
+    MachineInst inst = {op};
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    inst.imm = imm;
+    return inst;
+  }
+  static MachineInst U(MachineOp op, int rd, int32_t imm) {
+    MachineInst inst = {op};
+    inst.rd = rd;
+    inst.imm = imm;
+    return inst;
+  }
+  static MachineInst Unary(MachineOp op, int rd, int rs1) {
+    MachineInst inst = {op};
+    inst.rd = rd;
+    inst.rs1 = rs1;
+    return inst;
+  }
+  static MachineInst Load(int rd, int base, int32_t offset) {
+    return I(MachineOp::LW, rd, base, offset);
+  }
+  static MachineInst Store(int src, int base, int32_t offset) {
+    MachineInst inst = {MachineOp::SW};
+    inst.rs1 = base;
+    inst.rs2 = src;
+    inst.imm = offset;
+    return inst;
+  }
+  static MachineInst BranchZ(MachineOp op, int rs1, koopa_raw_basic_block_t target) {
+    MachineInst inst = {op};
+    inst.rs1 = rs1;
+    inst.target = target;
+    return inst;
+  }
+  static MachineInst Branch(MachineOp op, int rs1, int rs2, koopa_raw_basic_block_t target) {
+    MachineInst inst = {op};
+    inst.rs1 = rs1;
+    inst.rs2 = rs2;
+    inst.target = target;
+    return inst;
+  }
+  static MachineInst Jump(koopa_raw_basic_block_t target) {
+    MachineInst inst = {MachineOp::J};
+    inst.target = target;
+    return inst;
+  }
+  static MachineInst Ret() { return {MachineOp::RET}; }
+  static MachineInst Label(koopa_raw_basic_block_t bb) {
+    MachineInst inst = {MachineOp::LABEL};
+    inst.target = bb;
+    return inst;
+  }
+
+  const MachineOpInfo& Info() const { return GetMachineOpInfo(op); }
+  bool IsLabel() const { return op == MachineOp::LABEL; }
+  // 跳转, 分支和 ret
+  bool IsTerminator() const;
+  // 除了写 rd 之外还有其他作用 (访存, 控制流, 修改 sp), 不能因为结果没用而删除
+  bool HasSideEffects() const;
+  // 写入的寄存器, 没有时返回 -1
+  int Def() const;
+  // 读取的物理寄存器集合 (以 x0 ~ x31 为位的掩码), 不包括 zero 和虚拟寄存器
+  uint32_t Uses() const;
+  // 寄存器分配改写操作数用: 写入的寄存器操作数 (没有时为 nullptr),
+  // 以及读取的寄存器操作数 (返回个数, 不包括 ret 隐含读取的寄存器)
+  int *DefOperand();
+  int UseOperands(int *regs[2]);
+};
+
+// 一个函数的机器指令
+struct MachineFunction {
+  // 函数名 (不含 '@'), 基本块的标号是 函数名_块名
+  const char *name = nullptr;
+  std::vector<MachineInst> insts;
+  // 下一个可用的虚拟寄存器
+  int next_vreg = kFirstVirtualReg;
+  // 栈帧中已经分配出去的字节数: 指令选择时是 alloc 出的变量, 寄存器分配之后再加上溢出槽
+  int frame_bytes = 0;
+
+  int NewVirtualReg() { return next_vreg ++; }
+};
+
+// 机器指令的控制流图: 标号开始一个新块, 跳转/分支/ret 结束当前块
+struct MachineCFG {
+  // 第 b 个块是指令 [starts[b], ends[b])
+  std::vector<size_t> starts;
+  std::vector<size_t> ends;
+  std::vector<std::vector<size_t>> succs;
+
+  size_t Size() const { return starts.size(); }
+};
+
+MachineCFG BuildMachineCFG(const MachineFunction &func);
+
+// 生成常用的指令序列, 追加到 insts 末尾
+// 把常量放进 reg: 12 位以内用 li (即 addi reg, zero, imm), 否则用 lui + addi
+void EmitLoadImm(std::vector<MachineInst> &insts, int reg, int32_t value);
+// 访问 sp + offset 处的栈槽, 偏移超出 12 位立即数时借助 tmp 计算地址 (读取时 tmp 可以就是 reg)
+void EmitStackLoad(std::vector<MachineInst> &insts, int reg, int offset, int tmp);
+void EmitStackStore(std::vector<MachineInst> &insts, int reg, int offset, int tmp);
+
+// 输出一个函数的汇编
+void PrintMachineFunction(const MachineFunction &func, OutputSink &out);
+
+#endif
@@ -0,0 +1,309 @@
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "opt.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// raw program 中的节点都是 builder 以非 const 方式分配的, 优化时可以安全地去掉 const
+koopa_raw_value_data_t* Mut(koopa_raw_value_t value) {
+  return const_cast<koopa_raw_value_data_t*>(value);
+}
+
+koopa_raw_basic_block_data_t* Mut(koopa_raw_basic_block_t bb) {
+  return const_cast<koopa_raw_basic_block_data_t*>(bb);
+}
+
+bool IsInteger(koopa_raw_value_t value) {
+  return value->kind.tag == KOOPA_RVT_INTEGER;
+}
+
+// 依次传入指令的每个操作数的引用, 回调可以直接改写操作数
+template <typename F>
+void ForEachOperand(koopa_raw_value_data_t *inst, F f) {
+  auto &kind = inst->kind;
+  switch (kind.tag) {
+    case KOOPA_RVT_BINARY:
+      f(kind.data.binary.lhs);
+      f(kind.data.binary.rhs);
+      break;
+    case KOOPA_RVT_RETURN:
+      if (kind.data.ret.value) f(kind.data.ret.value);
+      break;
+    case KOOPA_RVT_BRANCH:
+      f(kind.data.branch.cond);
+      break;
+    case KOOPA_RVT_LOAD:
+      f(kind.data.load.src);
+      break;
+    case KOOPA_RVT_STORE:
+      f(kind.data.store.value);
+      f(kind.data.store.dest);
+      break;
+    default:
+      break;
+  }
+}
+
+bool IsTerminator(koopa_raw_value_t inst) {
+  auto tag = inst->kind.tag;
+  return tag == KOOPA_RVT_RETURN || tag == KOOPA_RVT_BRANCH || tag == KOOPA_RVT_JUMP;
+}
+
+// 没有副作用的指令, 结果没人用时可以删除
+bool IsPure(koopa_raw_value_t inst) {
+  auto tag = inst->kind.tag;
+  return tag == KOOPA_RVT_BINARY || tag == KOOPA_RVT_LOAD || tag == KOOPA_RVT_ALLOC;
+}
+
+bool IsCommutative(koopa_raw_binary_op_t op) {
+  switch (op) {
+    case KOOPA_RBO_ADD: case KOOPA_RBO_MUL:
+    case KOOPA_RBO_EQ: case KOOPA_RBO_NOT_EQ:
+    case KOOPA_RBO_AND: case KOOPA_RBO_OR: case KOOPA_RBO_XOR:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// 局部值编号的键: 操作符加上两个 (已经规范化的) 操作数
+struct ExprKey {
+  koopa_raw_binary_op_t op;
+  koopa_raw_value_t lhs;
+  koopa_raw_value_t rhs;
+
+  bool operator==(const ExprKey &other) const {
+    return op == other.op && lhs == other.lhs && rhs == other.rhs;
+  }
+};
+
+struct ExprKeyHash {
+  size_t operator()(const ExprKey &key) const {
+    size_t h = std::hash<const void*>()(key.lhs);
+    h = h * 31 + std::hash<const void*>()(key.rhs);
+    return h * 31 + key.op;
+  }
+};
+
+class FunctionOptimizer {
+ public:
+  FunctionOptimizer(koopa_raw_function_t func, KoopaBuilder &builder, bool fold, OptStats &stats)
+      : func_(func), builder_(builder), fold_(fold), stats_(stats) {}
+
+  void Run() {
+    RemoveUnreachableInsts();
+    FoldAndNumber();
+    RemoveDeadValues();
+  }
+
+ private:
+  koopa_raw_function_t func_;
+  KoopaBuilder &builder_;
+  bool fold_;
+  OptStats &stats_;
+  // 被替换掉的指令 -> 替换它的值
+  std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replaced_;
+  // 每个整数值对应唯一的常量节点, 这样相同的常量操作数指针也相同, 可以直接作为 CSE 的键
+  std::unordered_map<int32_t, koopa_raw_value_t> constants_;
+
+  koopa_raw_basic_block_t Block(size_t i) const {
+    return reinterpret_cast<koopa_raw_basic_block_t>(func_->bbs.buffer[i]);
+  }
+
+  static koopa_raw_value_t Inst(koopa_raw_basic_block_t bb, size_t i) {
+    return reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+  }
+
+  koopa_raw_value_t Constant(int32_t value) {
+    auto it = constants_.find(value);
+    if (it != constants_.end()) return it->second;
+    koopa_raw_value_t ret = builder_.NewInteger(value);
+    constants_[value] = ret;
+    return ret;
+  }
+
+  // 操作数的规范形式: 先跟随替换关系, 常量统一成唯一节点
+  koopa_raw_value_t Canonical(koopa_raw_value_t value) {
+    auto it = replaced_.find(value);
+    if (it != replaced_.end()) value = it->second;
+    if (IsInteger(value)) {
+      auto cit = constants_.find(value->kind.data.integer.value);
+      if (cit != constants_.end()) return cit->second;
+      constants_[value->kind.data.integer.value] = value;
+    }
+    return value;
+  }
+
+  // 基本块中第一条终结指令之后的指令永远不会执行
+  void RemoveUnreachableInsts() {
+    for (size_t i = 0; i < func_->bbs.len; i ++) {
+      koopa_raw_basic_block_data_t *bb = Mut(Block(i));
+      for (uint32_t j = 0; j < bb->insts.len; j ++) {
+        if (IsTerminator(Inst(bb, j))) {
+          stats_.removed += bb->insts.len - (j + 1);
+          bb->insts.len = j + 1;
+          break;
+        }
+      }
+    }
+  }
+
+  // 把 x op c 这类代数恒等式化简成已有的值, 化简不了时返回 nullptr
+  koopa_raw_value_t Simplify(koopa_raw_binary_op_t op, koopa_raw_value_t lhs, koopa_raw_value_t rhs) {
+    auto is = [](koopa_raw_value_t v, int32_t c) {
+      return IsInteger(v) && v->kind.data.integer.value == c;
+    };
+    switch (op) {
+      case KOOPA_RBO_ADD:
+        if (is(rhs, 0)) return lhs;
+        if (is(lhs, 0)) return rhs;
+        break;
+      case KOOPA_RBO_SUB:
+        if (is(rhs, 0)) return lhs;
+        if (lhs == rhs) return Constant(0);
+        break;
+      case KOOPA_RBO_MUL:
+        if (is(rhs, 1)) return lhs;
+        if (is(lhs, 1)) return rhs;
+        if (is(lhs, 0) || is(rhs, 0)) return Constant(0);
+        break;
+      case KOOPA_RBO_DIV:
+        if (is(rhs, 1)) return lhs;
+        break;
+      case KOOPA_RBO_MOD:
+        if (is(rhs, 1)) return Constant(0);
+        break;
+      default:
+        break;
+    }
+    return nullptr;
+  }
+
+  // 常量传播/折叠 + 基本块内的值编号
+  // 只对 binary 做编号: load 的结果可能被中间的 store 改变
+  void FoldAndNumber() {
+    for (size_t i = 0; i < func_->bbs.len; i ++) {
+      koopa_raw_basic_block_t bb = Block(i);
+      std::unordered_map<ExprKey, koopa_raw_value_t, ExprKeyHash> available;
+      for (uint32_t j = 0; j < bb->insts.len; j ++) {
+        koopa_raw_value_data_t *inst = Mut(Inst(bb, j));
+        ForEachOperand(inst, [this](koopa_raw_value_t &operand) {
+          operand = Canonical(operand);
+        });
+        if (inst->kind.tag != KOOPA_RVT_BINARY) continue;
+
+        auto &binary = inst->kind.data.binary;
+        int32_t result;
+        if (fold_ && IsInteger(binary.lhs) && IsInteger(binary.rhs) &&
+            EvalBinary(binary.op, binary.lhs->kind.data.integer.value,
+                       binary.rhs->kind.data.integer.value, result)) {
+          TRACE(OPT, 2, "fold binary op " << binary.op << " to " << result);
+          replaced_[inst] = Constant(result);
+          stats_.folded ++;
+          continue;
+        }
+        koopa_raw_value_t simple = fold_ ? Simplify(binary.op, binary.lhs, binary.rhs) : nullptr;
+        if (simple) {
+          TRACE(OPT, 2, "simplify binary op " << binary.op);
+          replaced_[inst] = simple;
+          stats_.folded ++;
+          continue;
+        }
+
+        ExprKey key = {binary.op, binary.lhs, binary.rhs};
+        if (IsCommutative(binary.op) && key.rhs < key.lhs) std::swap(key.lhs, key.rhs);
+        auto it = available.find(key);
+        if (it != available.end()) {
+          TRACE(OPT, 2, "cse binary op " << binary.op);
+          replaced_[inst] = it->second;
+          stats_.cse ++;
+        } else {
+          available.emplace(key, inst);
+        }
+      }
+    }
+  }
+
+  // 从有副作用的指令出发标记所有被用到的值, 删除其余的纯指令
+  void RemoveDeadValues() {
+    std::unordered_set<koopa_raw_value_t> live;
+    std::vector<koopa_raw_value_t> worklist;
+    for (size_t i = 0; i < func_->bbs.len; i ++) {
+      koopa_raw_basic_block_t bb = Block(i);
+      for (uint32_t j = 0; j < bb->insts.len; j ++) {
+        koopa_raw_value_t inst = Inst(bb, j);
+        if (!IsPure(inst) && !replaced_.count(inst)) {
+          live.insert(inst);
+          worklist.push_back(inst);
+        }
+      }
+    }
+    while (!worklist.empty()) {
+      koopa_raw_value_t inst = worklist.back();
+      worklist.pop_back();
+      ForEachOperand(Mut(inst), [&](koopa_raw_value_t &operand) {
+        if (!IsInteger(operand) && live.insert(operand).second) worklist.push_back(operand);
+      });
+    }
+
+    for (size_t i = 0; i < func_->bbs.len; i ++) {
+      koopa_raw_basic_block_data_t *bb = Mut(Block(i));
+      uint32_t n = 0;
+      for (uint32_t j = 0; j < bb->insts.len; j ++) {
+        if (live.count(Inst(bb, j))) bb->insts.buffer[n ++] = bb->insts.buffer[j];
+      }
+      stats_.removed += bb->insts.len - n;
+      bb->insts.len = n;
+    }
+  }
+};
+
+}  // namespace
+
+bool EvalBinary(koopa_raw_binary_op_t op, int32_t l, int32_t r, int32_t &result) {
+  uint32_t ul = l, ur = r;
+  switch (op) {
+    case KOOPA_RBO_NOT_EQ: result = l != r; break;
+    case KOOPA_RBO_EQ: result = l == r; break;
+    case KOOPA_RBO_GT: result = l > r; break;
+    case KOOPA_RBO_LT: result = l < r; break;
+    case KOOPA_RBO_GE: result = l >= r; break;
+    case KOOPA_RBO_LE: result = l <= r; break;
+    case KOOPA_RBO_ADD: result = (int32_t)(ul + ur); break;
+    case KOOPA_RBO_SUB: result = (int32_t)(ul - ur); break;
+    case KOOPA_RBO_MUL: result = (int32_t)(ul * ur); break;
+    case KOOPA_RBO_DIV:
+      if (r == 0) return false;
+      result = (l == INT32_MIN && r == -1) ? l : l / r;
+      break;
+    case KOOPA_RBO_MOD:
+      if (r == 0) return false;
+      result = (l == INT32_MIN && r == -1) ? 0 : l % r;
+      break;
+    case KOOPA_RBO_AND: result = l & r; break;
+    case KOOPA_RBO_OR: result = l | r; break;
+    case KOOPA_RBO_XOR: result = l ^ r; break;
+    case KOOPA_RBO_SHL: result = (int32_t)(ul << (ur & 31)); break;
+    case KOOPA_RBO_SHR: result = (int32_t)(ul >> (ur & 31)); break;
+    case KOOPA_RBO_SAR: result = l >> (r & 31); break;
+    default: return false;
+  }
+  return true;
+}
+
+OptStats OptimizeProgram(koopa_raw_program_t &program, KoopaBuilder &builder, bool fold) {
+  OptStats stats;
+  for (size_t i = 0; i < program.funcs.len; i ++) {
+    auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+    TRACE(OPT, 1, "optimize function " << func->name);
+    FunctionOptimizer(func, builder, fold, stats).Run();
+  }
+  TRACE(OPT, 1, "folded " << stats.folded << ", cse " << stats.cse
+        << ", removed " << stats.removed);
+  return stats;
+}
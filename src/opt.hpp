@@ -0,0 +1,28 @@
+#ifndef __OPT_HPP__
+#define __OPT_HPP__
+
+#include <cstdint>
+#include "koopa.h"
+#include "koopa_builder.hpp"
+
+// 各个优化遍的统计信息
+struct OptStats {
+  // 折叠成常量的指令数
+  int folded = 0;
+  // 被公共子表达式消除替换掉的指令数
+  int cse = 0;
+  // 被删除的死指令数 (包括终结指令之后不可达的指令)
+  int removed = 0;
+};
+
+// 按 RISC-V 的语义计算 l op r, 加减乘按 32 位回绕
+// 除数为 0 时无法折叠, 返回 false. AST 上的常量折叠也用这个函数, 保证两边结果一致
+bool EvalBinary(koopa_raw_binary_op_t op, int32_t l, int32_t r, int32_t &result);
+
+// 在 raw program 上原地运行 -O1 优化流水线:
+// 常量传播/折叠 -> 局部值编号 (CSE) -> 死值删除
+// 折叠出的新常量由 builder 分配, 所以 builder 必须比 program 活得更久
+// fold 为 false 时 (-fno-fold) 跳过常量折叠和代数化简, 只做 CSE 和死值删除
+OptStats OptimizeProgram(koopa_raw_program_t &program, KoopaBuilder &builder, bool fold = true);
+
+#endif
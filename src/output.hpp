@@ -0,0 +1,97 @@
+#ifndef __OUTPUT_HPP__
+#define __OUTPUT_HPP__
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// 带缓冲的输出
+// IR 和汇编都直接写进一块可复用的大缓冲区, 写满或 Flush 时才落到文件里
+// 这样生成代码时不需要再拼接/拷贝临时字符串
+class OutputSink {
+ public:
+  static constexpr size_t kDefaultCapacity = 1 << 16;
+
+  explicit OutputSink(FILE *file = nullptr, size_t capacity = kDefaultCapacity)
+      : file_(file) {
+    buffer_.resize(capacity);
+  }
+  OutputSink(const OutputSink&) = delete;
+  OutputSink& operator=(const OutputSink&) = delete;
+  ~OutputSink() { Flush(); }
+
+  // 切换输出文件, 缓冲区保留下来继续使用
+  void Reset(FILE *file) {
+    Flush();
+    file_ = file;
+    capture_ = nullptr;
+  }
+  // 输出追加到 str 中而不是写文件, 例如 -serve 模式把结果直接返回给客户端
+  void Capture(std::string *str) {
+    Flush();
+    file_ = nullptr;
+    capture_ = str;
+  }
+
+  void Write(const char *data, size_t len) {
+    if (len > buffer_.size() - size_) {
+      Flush();
+      if (len > buffer_.size()) {
+        WriteThrough(data, len);
+        return;
+      }
+    }
+    memcpy(buffer_.data() + size_, data, len);
+    size_ += len;
+  }
+
+  void Flush() {
+    if (size_) WriteThrough(buffer_.data(), size_);
+    size_ = 0;
+  }
+
+  OutputSink& operator<<(const char *str) {
+    Write(str, strlen(str));
+    return *this;
+  }
+  OutputSink& operator<<(const std::string &str) {
+    Write(str.data(), str.size());
+    return *this;
+  }
+  OutputSink& operator<<(char c) {
+    if (size_ == buffer_.size()) Flush();
+    buffer_[size_ ++] = c;
+    return *this;
+  }
+  OutputSink& operator<<(int32_t value) {
+    // 直接在栈上转换, 避免 std::to_string 的临时字符串
+    char tmp[12];
+    int len = 0;
+    uint32_t abs_value = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+    do {
+      tmp[sizeof(tmp) - 1 - len ++] = '0' + abs_value % 10;
+      abs_value /= 10;
+    } while (abs_value);
+    if (value < 0) tmp[sizeof(tmp) - 1 - len ++] = '-';
+    Write(tmp + sizeof(tmp) - len, len);
+    return *this;
+  }
+
+ private:
+  void WriteThrough(const char *data, size_t len) {
+    if (capture_) {
+      capture_->append(data, len);
+    } else if (file_) {
+      fwrite(data, 1, len, file_);
+    }
+  }
+
+  FILE *file_;
+  std::string *capture_ = nullptr;
+  std::vector<char> buffer_;
+  size_t size_ = 0;
+};
+
+#endif
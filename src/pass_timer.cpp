@@ -0,0 +1,118 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include "pass_timer.hpp"
+
+static std::atomic<uint64_t> g_alloc_count(0);
+static std::atomic<uint64_t> g_alloc_bytes(0);
+
+static void* CountedAlloc(size_t size) {
+  g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  g_alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  return malloc(size ? size : 1);
+}
+
+// 替换全局的 operator new/delete, 只统计, 实际分配交给 malloc
+// operator new[] 的默认实现会转调 operator new, 不需要单独替换
+void* operator new(size_t size) {
+  void *p = CountedAlloc(size);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return CountedAlloc(size);
+}
+
+void operator delete(void *p) noexcept {
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  free(p);
+}
+
+AllocStats GetAllocStats() {
+  return {g_alloc_count.load(std::memory_order_relaxed),
+          g_alloc_bytes.load(std::memory_order_relaxed)};
+}
+
+static long PeakRssKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  // Linux 下 ru_maxrss 的单位是 KB
+  return usage.ru_maxrss;
+}
+
+void PassTimer::Start(const char *name) {
+  if (running_) Stop();
+  running_ = true;
+  name_ = name;
+  start_alloc_ = GetAllocStats();
+  start_time_ = std::chrono::steady_clock::now();
+}
+
+void PassTimer::Stop() {
+  if (!running_) return;
+  auto end_time = std::chrono::steady_clock::now();
+  AllocStats end_alloc = GetAllocStats();
+  running_ = false;
+  PassRecord record;
+  record.name = name_;
+  record.seconds = std::chrono::duration<double>(end_time - start_time_).count();
+  record.alloc_count = end_alloc.count - start_alloc_.count;
+  record.alloc_bytes = end_alloc.bytes - start_alloc_.bytes;
+  record.peak_rss_kb = PeakRssKb();
+  records_.push_back(record);
+}
+
+void PassTimer::AddCounter(const char *name, uint64_t value) {
+  for (auto &counter : counters_) {
+    if (counter.name == name) {
+      counter.value += value;
+      return;
+    }
+  }
+  counters_.push_back({name, value});
+}
+
+void PassTimer::Report(FILE *file) const {
+  double total = 0;
+  for (const auto &record : records_) total += record.seconds;
+  fprintf(file, "===-------------------------------------------------------------===\n");
+  fprintf(file, "                      Pass execution timing report\n");
+  fprintf(file, "===-------------------------------------------------------------===\n");
+  fprintf(file, "  %10s %7s %10s %12s %10s  %s\n",
+          "Wall(ms)", "%", "Allocs", "AllocBytes", "PeakRSS", "Name");
+  for (const auto &record : records_) {
+    fprintf(file, "  %10.3f %6.1f%% %10llu %12llu %8ldKB  %s\n",
+            record.seconds * 1000, total > 0 ? record.seconds * 100 / total : 0.0,
+            (unsigned long long)record.alloc_count,
+            (unsigned long long)record.alloc_bytes,
+            record.peak_rss_kb, record.name.c_str());
+  }
+  fprintf(file, "  %10.3f %6.1f%% %10s %12s %10s  %s\n",
+          total * 1000, 100.0, "", "", "", "Total");
+  for (const auto &counter : counters_) {
+    fprintf(file, "  %10llu  %s\n", (unsigned long long)counter.value, counter.name.c_str());
+  }
+}
+
+void PassTimer::ReportJson(FILE *file) const {
+  fprintf(file, "{\"passes\": [");
+  for (size_t i = 0; i < records_.size(); i ++) {
+    const auto &record = records_[i];
+    fprintf(file, "%s\n  {\"name\": \"%s\", \"wall_ms\": %.6f, \"alloc_count\": %llu, "
+            "\"alloc_bytes\": %llu, \"peak_rss_kb\": %ld}",
+            i ? "," : "", record.name.c_str(), record.seconds * 1000,
+            (unsigned long long)record.alloc_count,
+            (unsigned long long)record.alloc_bytes, record.peak_rss_kb);
+  }
+  fprintf(file, "\n], \"counters\": {");
+  for (size_t i = 0; i < counters_.size(); i ++) {
+    fprintf(file, "%s\"%s\": %llu", i ? ", " : "", counters_[i].name.c_str(),
+            (unsigned long long)counters_[i].value);
+  }
+  fprintf(file, "}}\n");
+}
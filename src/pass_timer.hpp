@@ -0,0 +1,54 @@
+#ifndef __PASS_TIMER_HPP__
+#define __PASS_TIMER_HPP__
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// 进程内堆分配的累计次数/字节数, 由 pass_timer.cpp 中替换的 operator new 统计
+struct AllocStats {
+  uint64_t count;
+  uint64_t bytes;
+};
+AllocStats GetAllocStats();
+
+// -time-passes: 统计每个编译阶段的耗时, 堆分配次数/字节数以及峰值 RSS
+class PassTimer {
+ public:
+  struct PassRecord {
+    std::string name;
+    double seconds;
+    uint64_t alloc_count;
+    uint64_t alloc_bytes;
+    // 到该阶段结束为止的峰值 RSS, 单位 KB
+    long peak_rss_kb;
+  };
+
+  // 开始一个阶段, 如果上一个阶段还没有结束会先结束它
+  void Start(const char *name);
+  void Stop();
+
+  // 各个阶段自己的统计数字 (例如优化删掉的指令数), 同名的计数会累加
+  struct Counter {
+    std::string name;
+    uint64_t value;
+  };
+  void AddCounter(const char *name, uint64_t value);
+
+  const std::vector<PassRecord>& Records() const { return records_; }
+  const std::vector<Counter>& Counters() const { return counters_; }
+  void Report(FILE *file) const;
+  void ReportJson(FILE *file) const;
+
+ private:
+  bool running_ = false;
+  std::string name_;
+  std::chrono::steady_clock::time_point start_time_;
+  AllocStats start_alloc_;
+  std::vector<PassRecord> records_;
+  std::vector<Counter> counters_;
+};
+
+#endif
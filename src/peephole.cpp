@@ -0,0 +1,392 @@
+#include <cassert>
+#include <vector>
+#include "peephole.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// 对一个函数的指令列表反复应用各条规则, 直到没有变化
+class Peephole {
+ public:
+  Peephole(MachineFunction &func, int window) : func_(func), insts_(func.insts), window_(window) {}
+
+  size_t Run();
+
+ private:
+  // 每次修改指令列表之后, 活跃信息都要重新计算
+  void ComputeLiveness();
+  bool LiveAfter(size_t i, int reg);
+
+  // 从 i 向前查找的起点: 最多 window_ 条指令, 不越过标号和跳转
+  size_t ScanStart(size_t i) const;
+  // 在 [ScanStart(i), i) 中查找最近一条写 reg 的指令, 找不到时返回 -1
+  long FindDef(size_t i, int reg) const;
+  // (from, to) 之间是否有指令读/写 reg
+  bool ReadsBetween(size_t from, size_t to, int reg) const;
+  bool WritesBetween(size_t from, size_t to, int reg) const;
+
+  void Erase(size_t i);
+  void Replace(size_t i, const MachineInst &inst);
+
+  // 各条规则, 成功修改指令列表时返回 true
+  bool SimplifyTrivial(size_t i);
+  bool RemoveRedundantLi(size_t i);
+  bool ForwardStackLoad(size_t i);
+  bool RemoveRedundantStore(size_t i);
+  bool RemoveDeadStore(size_t i);
+  bool SimplifyBoolChain(size_t i);
+  bool FuseCompareBranch(size_t i);
+  bool InvertBranchOverJump(size_t i);
+  bool CoalesceMove(size_t i);
+  bool RemoveDeadWrite(size_t i);
+
+  MachineFunction &func_;
+  std::vector<MachineInst> &insts_;
+  int window_;
+  bool live_valid_ = false;
+  // 每条指令之后活跃的寄存器 (掩码)
+  std::vector<uint32_t> live_after_;
+};
+
+size_t Peephole::Run() {
+  size_t before = insts_.size();
+  // 每一轮都可能为下一轮创造新的机会 (例如合并分支之后比较指令就没用了), 轮数设个上限
+  for (int round = 0; round < 16; round ++) {
+    bool changed = false;
+    for (size_t i = 0; i < insts_.size(); ) {
+      if (SimplifyTrivial(i) || RemoveRedundantLi(i) || ForwardStackLoad(i) ||
+          RemoveRedundantStore(i) || RemoveDeadStore(i) || SimplifyBoolChain(i) ||
+          FuseCompareBranch(i) || InvertBranchOverJump(i) || CoalesceMove(i) ||
+          RemoveDeadWrite(i)) {
+        changed = true;
+        // 位置 i 上的指令变了 (或者被删掉了), 在同一位置继续尝试
+        continue;
+      }
+      i ++;
+    }
+    if (!changed) break;
+  }
+  size_t removed = before - insts_.size();
+  TRACE(PEEPHOLE, 1, func_.name << ": removed " << removed << " of " << before << " instructions");
+  return removed;
+}
+
+void Peephole::ComputeLiveness() {
+  size_t n = insts_.size();
+  MachineCFG cfg = BuildMachineCFG(func_);
+  size_t blocks = cfg.Size();
+
+  // 经典的后向数据流, 逆序迭代收敛得快
+  std::vector<uint32_t> live_in(blocks, 0);
+  live_after_.assign(n, 0);
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t b = blocks; b -- > 0; ) {
+      uint32_t live = 0;
+      for (size_t succ : cfg.succs[b]) live |= live_in[succ];
+      for (size_t i = cfg.ends[b]; i -- > cfg.starts[b]; ) {
+        live_after_[i] = live;
+        int def = insts_[i].Def();
+        if (def >= 0) live &= ~(1u << def);
+        live |= insts_[i].Uses();
+      }
+      if (live != live_in[b]) {
+        live_in[b] = live;
+        changed = true;
+      }
+    }
+  }
+  live_valid_ = true;
+}
+
+bool Peephole::LiveAfter(size_t i, int reg) {
+  if (!live_valid_) ComputeLiveness();
+  return (live_after_[i] >> reg) & 1;
+}
+
+size_t Peephole::ScanStart(size_t i) const {
+  size_t k = i;
+  while (k > 0 && i - k < (size_t)window_) {
+    const MachineInst &prev = insts_[k - 1];
+    if (prev.IsLabel() || prev.IsTerminator()) break;
+    k --;
+  }
+  return k;
+}
+
+long Peephole::FindDef(size_t i, int reg) const {
+  for (size_t k = i; k -- > ScanStart(i); ) {
+    if (insts_[k].Def() == reg) return k;
+  }
+  return -1;
+}
+
+bool Peephole::ReadsBetween(size_t from, size_t to, int reg) const {
+  for (size_t k = from + 1; k < to; k ++) {
+    if ((insts_[k].Uses() >> reg) & 1) return true;
+  }
+  return false;
+}
+
+bool Peephole::WritesBetween(size_t from, size_t to, int reg) const {
+  for (size_t k = from + 1; k < to; k ++) {
+    if (insts_[k].Def() == reg) return true;
+  }
+  return false;
+}
+
+void Peephole::Erase(size_t i) {
+  TRACE(PEEPHOLE, 2, "erase " << insts_[i].Info().name << " at " << i);
+  insts_.erase(insts_.begin() + i);
+  live_valid_ = false;
+}
+
+void Peephole::Replace(size_t i, const MachineInst &inst) {
+  TRACE(PEEPHOLE, 2, "replace " << insts_[i].Info().name << " with " << inst.Info().name
+        << " at " << i);
+  insts_[i] = inst;
+  live_valid_ = false;
+}
+
+// mv x, x / addi x, x, 0 / 跳转到紧接着的标号 / 常量条件的分支
+bool Peephole::SimplifyTrivial(size_t i) {
+  const MachineInst &inst = insts_[i];
+  switch (inst.op) {
+    case MachineOp::MV:
+      if (inst.rd == inst.rs1) {
+        Erase(i);
+        return true;
+      }
+      return false;
+    case MachineOp::ADDI:
+      if (inst.rd == inst.rs1 && inst.imm == 0) {
+        Erase(i);
+        return true;
+      }
+      return false;
+    case MachineOp::J:
+      if (i + 1 < insts_.size() && insts_[i + 1].IsLabel() && insts_[i + 1].target == inst.target) {
+        Erase(i);
+        return true;
+      }
+      return false;
+    case MachineOp::BNEZ:
+      // zero 永远为 0, 分支不会跳转
+      if (inst.rs1 == RV_ZERO) {
+        Erase(i);
+        return true;
+      }
+      return false;
+    case MachineOp::BEQZ:
+      if (inst.rs1 == RV_ZERO) {
+        Replace(i, MachineInst::Jump(inst.target));
+        return true;
+      }
+      return false;
+    default:
+      return false;
+  }
+}
+
+// li r, c 之前 r 已经是 c 了
+bool Peephole::RemoveRedundantLi(size_t i) {
+  const MachineInst &inst = insts_[i];
+  if (inst.op != MachineOp::LI) return false;
+  long k = FindDef(i, inst.rd);
+  if (k < 0 || insts_[k].op != MachineOp::LI || insts_[k].imm != inst.imm) return false;
+  Erase(i);
+  return true;
+}
+
+// lw r2, off(sp): 如果同一个栈槽刚被写入/读出过, 并且对应的寄存器没有被改写, 直接使用那个寄存器
+bool Peephole::ForwardStackLoad(size_t i) {
+  const MachineInst &inst = insts_[i];
+  if (inst.op != MachineOp::LW || inst.rs1 != RV_SP) return false;
+  for (size_t k = i; k -- > ScanStart(i); ) {
+    const MachineInst &prev = insts_[k];
+    if (prev.Def() == RV_SP) return false;
+    int source = -1;
+    if (prev.op == MachineOp::SW) {
+      // 地址不是 sp + 常量的写入可能写到同一个栈槽
+      if (prev.rs1 != RV_SP) return false;
+      if (prev.imm == inst.imm) source = prev.rs2;
+    } else if (prev.op == MachineOp::LW && prev.rs1 == RV_SP && prev.imm == inst.imm) {
+      source = prev.rd;
+    }
+    if (source < 0) continue;
+    if (WritesBetween(k, i, source)) return false;
+    if (source == inst.rd) {
+      Erase(i);
+    } else {
+      Replace(i, MachineInst::Unary(MachineOp::MV, inst.rd, source));
+    }
+    return true;
+  }
+  return false;
+}
+
+// sw r, off(sp): 栈槽中已经是 r 的值了
+bool Peephole::RemoveRedundantStore(size_t i) {
+  const MachineInst &inst = insts_[i];
+  if (inst.op != MachineOp::SW || inst.rs1 != RV_SP) return false;
+  for (size_t k = i; k -- > ScanStart(i); ) {
+    const MachineInst &prev = insts_[k];
+    if (prev.Def() == RV_SP) return false;
+    if (prev.op == MachineOp::SW && (prev.rs1 != RV_SP || prev.imm == inst.imm)) {
+      if (prev.rs1 != RV_SP || prev.rs2 != inst.rs2) return false;
+    } else if (prev.op != MachineOp::LW || prev.rs1 != RV_SP || prev.imm != inst.imm ||
+               prev.rd != inst.rs2) {
+      continue;
+    }
+    if (WritesBetween(k, i, inst.rs2)) return false;
+    Erase(i);
+    return true;
+  }
+  return false;
+}
+
+// sw x, off(sp) 之后, 在读这个栈槽之前又写了一次, 第一次写入没有用
+// 只在基本块内部向后查找, 其他块可能读这个栈槽
+bool Peephole::RemoveDeadStore(size_t i) {
+  const MachineInst &inst = insts_[i];
+  if (inst.op != MachineOp::SW || inst.rs1 != RV_SP) return false;
+  for (size_t k = i + 1; k < insts_.size() && k - i <= (size_t)window_; k ++) {
+    const MachineInst &next = insts_[k];
+    if (next.IsLabel() || next.IsTerminator() || next.Def() == RV_SP) return false;
+    if (next.op == MachineOp::LW && (next.rs1 != RV_SP || next.imm == inst.imm)) return false;
+    if (next.op == MachineOp::SW && next.rs1 == RV_SP && next.imm == inst.imm) {
+      Erase(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// seqz/snez 的嵌套 (来自 !!x 之类的表达式) 化简成一条
+bool Peephole::SimplifyBoolChain(size_t i) {
+  const MachineInst &inst = insts_[i];
+  if (inst.op != MachineOp::SEQZ && inst.op != MachineOp::SNEZ) return false;
+  long k = FindDef(i, inst.rs1);
+  if (k < 0) return false;
+  const MachineInst &inner = insts_[k];
+  if (inner.op == MachineOp::SEQZ || inner.op == MachineOp::SNEZ) {
+    // inner 的操作数在 inner 和 inst 之间不能被改写
+    if (inner.rs1 == inner.rd || WritesBetween(k, i, inner.rs1)) return false;
+    // seqz(seqz x) = snez x, 其余三种组合的结果与内层相同
+    MachineOp op = inner.op;
+    if (inst.op == MachineOp::SEQZ && inner.op == MachineOp::SEQZ) op = MachineOp::SNEZ;
+    Replace(i, MachineInst::Unary(op, inst.rd, inner.rs1));
+    return true;
+  }
+  // 比较的结果已经是 0/1, snez 不改变它
+  if (inst.op == MachineOp::SNEZ && (inner.op == MachineOp::SLT || inner.op == MachineOp::SGT ||
+                                     inner.op == MachineOp::SLTI)) {
+    Replace(i, MachineInst::Unary(MachineOp::MV, inst.rd, inst.rs1));
+    return true;
+  }
+  return false;
+}
+
+// bnez/beqz c, L: 直接对产生 c 的比较做分支, 比较本身没有其他用处时会被当作无用写入删掉
+bool Peephole::FuseCompareBranch(size_t i) {
+  const MachineInst &inst = insts_[i];
+  if (inst.op != MachineOp::BNEZ && inst.op != MachineOp::BEQZ) return false;
+  if (inst.rs1 == RV_ZERO) return false;
+  long k = FindDef(i, inst.rs1);
+  if (k < 0) return false;
+  const MachineInst &def = insts_[k];
+  // c 的操作数在比较和分支之间不能被改写
+  uint32_t operands = def.Uses();
+  for (size_t j = k + 1; j < i; j ++) {
+    int d = insts_[j].Def();
+    if (d >= 0 && ((operands >> d) & 1)) return false;
+  }
+  if (def.Uses() & (1u << def.rd)) {
+    // 比较覆盖了自己的操作数, 分支再读操作数就错了
+    return false;
+  }
+  bool if_nonzero = inst.op == MachineOp::BNEZ;
+  MachineInst fused;
+  switch (def.op) {
+    case MachineOp::SEQZ:
+      fused = MachineInst::BranchZ(if_nonzero ? MachineOp::BEQZ : MachineOp::BNEZ, def.rs1, inst.target);
+      break;
+    case MachineOp::SNEZ:
+    case MachineOp::MV:
+      fused = MachineInst::BranchZ(inst.op, def.rs1, inst.target);
+      break;
+    case MachineOp::SLT:
+      fused = MachineInst::Branch(if_nonzero ? MachineOp::BLT : MachineOp::BGE, def.rs1, def.rs2, inst.target);
+      break;
+    case MachineOp::SGT:
+      fused = MachineInst::Branch(if_nonzero ? MachineOp::BLT : MachineOp::BGE, def.rs2, def.rs1, inst.target);
+      break;
+    case MachineOp::XOR:
+    case MachineOp::SUB:
+      // a ^ b != 0 当且仅当 a != b
+      fused = MachineInst::Branch(if_nonzero ? MachineOp::BNE : MachineOp::BEQ, def.rs1, def.rs2, inst.target);
+      break;
+    default:
+      return false;
+  }
+  Replace(i, fused);
+  return true;
+}
+
+// b.cond L1; j L2; L1:  =>  b.!cond L2; L1:
+bool Peephole::InvertBranchOverJump(size_t i) {
+  if (i + 2 >= insts_.size()) return false;
+  const MachineInst &inst = insts_[i];
+  const MachineInst &jump = insts_[i + 1];
+  const MachineInst &label = insts_[i + 2];
+  if (jump.op != MachineOp::J || !label.IsLabel() || label.target != inst.target) return false;
+  MachineOp inverted;
+  switch (inst.op) {
+    case MachineOp::BEQZ: inverted = MachineOp::BNEZ; break;
+    case MachineOp::BNEZ: inverted = MachineOp::BEQZ; break;
+    case MachineOp::BEQ: inverted = MachineOp::BNE; break;
+    case MachineOp::BNE: inverted = MachineOp::BEQ; break;
+    case MachineOp::BLT: inverted = MachineOp::BGE; break;
+    case MachineOp::BGE: inverted = MachineOp::BLT; break;
+    default: return false;
+  }
+  MachineInst branch = inst;
+  branch.op = inverted;
+  branch.target = jump.target;
+  Replace(i, branch);
+  Erase(i + 1);
+  return true;
+}
+
+// op x, ...; mv y, x  =>  op y, ...  (x 之后不再使用, 例如返回前的 mv a0, tX)
+bool Peephole::CoalesceMove(size_t i) {
+  const MachineInst &inst = insts_[i];
+  if (inst.op != MachineOp::MV) return false;
+  int x = inst.rs1, y = inst.rd;
+  if (x == y || x == RV_ZERO || x == RV_SP || y == RV_SP) return false;
+  long k = FindDef(i, x);
+  if (k < 0 || insts_[k].HasSideEffects()) return false;
+  if (ReadsBetween(k, i, x) || ReadsBetween(k, i, y) || WritesBetween(k, i, y)) return false;
+  if (LiveAfter(i, x)) return false;
+  MachineInst def = insts_[k];
+  def.rd = y;
+  Replace(k, def);
+  Erase(i);
+  return true;
+}
+
+// 结果不再被使用, 也没有其他作用的指令
+bool Peephole::RemoveDeadWrite(size_t i) {
+  const MachineInst &inst = insts_[i];
+  int def = inst.Def();
+  if (def < 0 || inst.HasSideEffects() || LiveAfter(i, def)) return false;
+  Erase(i);
+  return true;
+}
+
+}  // namespace
+
+size_t RunPeephole(MachineFunction &func, int window) {
+  return Peephole(func, window).Run();
+}
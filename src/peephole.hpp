@@ -0,0 +1,13 @@
+#ifndef __PEEPHOLE_HPP__
+#define __PEEPHOLE_HPP__
+
+#include <cstddef>
+#include "mir.hpp"
+
+// 在一个函数的机器指令上做窥孔优化, 返回删掉的指令数
+// window 是每条规则向前查找相关指令时最多看的指令数, 查找不会越过基本块的边界
+// 包括: 重复的 li 和栈槽读取的消除, 比较与分支的合并, 把 mv 合并进产生值的指令,
+// 布尔运算链的化简, 无用写入 (寄存器和栈槽) 的删除, 以及跳转到紧接着的标号的 j
+size_t RunPeephole(MachineFunction &func, int window);
+
+#endif
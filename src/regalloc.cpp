@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include "regalloc.hpp"
+#include "riscv.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// 参与分配的寄存器, 按优先顺序排列
+// 先用不需要保存的 t/a 寄存器, 不够时再用 s 寄存器
+const int kAllocatableRegs[] = {
+  RV_T2, RV_T3, RV_T4, RV_T5, RV_T6,
+  RV_A1, RV_A2, RV_A3, RV_A4, RV_A5, RV_A6, RV_A7, RV_A0,
+  RV_S1, RV_S2, RV_S3, RV_S4, RV_S5, RV_S6, RV_S7, RV_S8, RV_S9, RV_S10, RV_S11, RV_S0
+};
+
+// 区间的位置是指令在 func.insts 中的下标
+struct LiveInterval {
+  int vreg;
+  int start = INT_MAX;
+  int end = -1;
+};
+
+class LinearScan {
+ public:
+  explicit LinearScan(MachineFunction &func) : func_(func), insts_(func.insts) {}
+
+  RegisterAllocation Run() {
+    ComputeIntervals();
+    Allocate();
+    Rewrite();
+    LayoutFrame();
+    return std::move(result_);
+  }
+
+ private:
+  MachineFunction &func_;
+  std::vector<MachineInst> &insts_;
+  // 下标是 vreg - kFirstVirtualReg
+  std::vector<LiveInterval> intervals_;
+  // 分配到的物理寄存器, 被溢出时为 -1
+  std::vector<int> assigned_;
+  // 溢出槽相对 sp 的偏移
+  std::vector<int> spill_offsets_;
+  RegisterAllocation result_;
+
+  static int Index(int vreg) { return vreg - kFirstVirtualReg; }
+
+  void Extend(int id, int pos) {
+    intervals_[id].start = std::min(intervals_[id].start, pos);
+    intervals_[id].end = std::max(intervals_[id].end, pos);
+  }
+
+  // 先按基本块求活跃的虚拟寄存器, 再把每个虚拟寄存器覆盖到的位置合并成一个区间
+  void ComputeIntervals() {
+    size_t vreg_count = func_.next_vreg - kFirstVirtualReg;
+    intervals_.resize(vreg_count);
+    for (size_t v = 0; v < vreg_count; v ++) intervals_[v].vreg = v + kFirstVirtualReg;
+
+    MachineCFG cfg = BuildMachineCFG(func_);
+    size_t bb_count = cfg.Size();
+    // upward_use: 在块内定义之前就被使用的寄存器, defined: 块内定义的寄存器
+    std::vector<std::vector<bool>> upward_use(bb_count, std::vector<bool>(vreg_count));
+    std::vector<std::vector<bool>> defined(bb_count, std::vector<bool>(vreg_count));
+    for (size_t b = 0; b < bb_count; b ++) {
+      for (size_t i = cfg.starts[b]; i < cfg.ends[b]; i ++) {
+        int *uses[2];
+        int use_count = insts_[i].UseOperands(uses);
+        for (int k = 0; k < use_count; k ++) {
+          if (!IsVirtualReg(*uses[k])) continue;
+          int id = Index(*uses[k]);
+          Extend(id, i);
+          if (!defined[b][id]) upward_use[b][id] = true;
+        }
+        int *def = insts_[i].DefOperand();
+        if (def && IsVirtualReg(*def)) {
+          Extend(Index(*def), i);
+          defined[b][Index(*def)] = true;
+        }
+      }
+    }
+
+    // live_in = use ∪ (live_out - def), 迭代到不动点
+    std::vector<std::vector<bool>> live_in(bb_count, std::vector<bool>(vreg_count));
+    std::vector<std::vector<bool>> live_out(bb_count, std::vector<bool>(vreg_count));
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t k = bb_count; k -- > 0; ) {
+        for (size_t succ : cfg.succs[k]) {
+          for (size_t v = 0; v < vreg_count; v ++) {
+            if (live_in[succ][v] && !live_out[k][v]) {
+              live_out[k][v] = true;
+              changed = true;
+            }
+          }
+        }
+        for (size_t v = 0; v < vreg_count; v ++) {
+          bool in = upward_use[k][v] || (live_out[k][v] && !defined[k][v]);
+          if (in && !live_in[k][v]) {
+            live_in[k][v] = true;
+            changed = true;
+          }
+        }
+      }
+    }
+    for (size_t b = 0; b < bb_count; b ++) {
+      for (size_t v = 0; v < vreg_count; v ++) {
+        if (live_in[b][v]) Extend(v, cfg.starts[b]);
+        if (live_out[b][v]) Extend(v, cfg.ends[b] - 1);
+      }
+    }
+  }
+
+  void Spill(const LiveInterval &interval) {
+    int id = Index(interval.vreg);
+    assigned_[id] = -1;
+    spill_offsets_[id] = func_.frame_bytes;
+    func_.frame_bytes += 4;
+    TRACE(REGALLOC, 2, "spill %v" << id << " at [" << interval.start << ", " << interval.end
+          << "] to " << spill_offsets_[id] << "(sp)");
+  }
+
+  void Assign(const LiveInterval &interval, int reg) {
+    int id = Index(interval.vreg);
+    assigned_[id] = reg;
+    TRACE(REGALLOC, 2, "%v" << id << " at [" << interval.start << ", " << interval.end
+          << "] -> " << RiscvRegName(reg));
+  }
+
+  void Allocate() {
+    assigned_.assign(intervals_.size(), -1);
+    spill_offsets_.assign(intervals_.size(), -1);
+    std::vector<LiveInterval> sorted;
+    for (const auto &interval : intervals_) {
+      // 只创建了但没有出现在任何指令中的虚拟寄存器
+      if (interval.end >= 0) sorted.push_back(interval);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const LiveInterval &a, const LiveInterval &b) {
+      return a.start < b.start;
+    });
+    std::vector<int> free_regs(std::rbegin(kAllocatableRegs), std::rend(kAllocatableRegs));
+    // active 按 end 升序排列
+    std::vector<std::pair<LiveInterval, int>> active;
+    for (const auto &cur : sorted) {
+      // 在 cur 定义的位置最后一次使用的寄存器可以让给 cur: 指令总是先读操作数再写结果
+      while (!active.empty() && active.front().first.end <= cur.start) {
+        free_regs.push_back(active.front().second);
+        active.erase(active.begin());
+      }
+      int reg;
+      if (!free_regs.empty()) {
+        reg = free_regs.back();
+        free_regs.pop_back();
+      } else {
+        // 没有空闲寄存器: 溢出结束得最晚的区间
+        auto &last = active.back();
+        if (last.first.end <= cur.end) {
+          Spill(cur);
+          continue;
+        }
+        Spill(last.first);
+        reg = last.second;
+        active.pop_back();
+      }
+      Assign(cur, reg);
+      auto it = std::upper_bound(active.begin(), active.end(), cur.end,
+                                 [](int end, const std::pair<LiveInterval, int> &item) {
+                                   return end < item.first.end;
+                                 });
+      active.insert(it, {cur, reg});
+    }
+  }
+
+  // 把虚拟寄存器换成分配到的物理寄存器, 删掉变成 mv x, x 的指令
+  // 溢出的操作数在指令之前加载到 t0 (第一个操作数) 或 t1 (第二个操作数), 溢出的结果写到 t0, 指令之后存回栈上
+  void Rewrite() {
+    std::vector<MachineInst> rewritten;
+    rewritten.reserve(insts_.size());
+    for (MachineInst inst : insts_) {
+      int *uses[2];
+      int use_count = inst.UseOperands(uses);
+      int reloaded = -1;
+      for (int k = 0; k < use_count; k ++) {
+        int reg = *uses[k];
+        if (!IsVirtualReg(reg)) continue;
+        int id = Index(reg);
+        if (assigned_[id] >= 0) {
+          *uses[k] = assigned_[id];
+        } else if (reg == reloaded) {
+          // 两个操作数是同一个溢出的寄存器
+          *uses[k] = RV_T0;
+        } else {
+          int scratch = k == 0 ? RV_T0 : RV_T1;
+          EmitStackLoad(rewritten, scratch, spill_offsets_[id], scratch);
+          *uses[k] = scratch;
+          if (k == 0) reloaded = reg;
+        }
+      }
+      int *def = inst.DefOperand();
+      int spill_offset = -1;
+      if (def && IsVirtualReg(*def)) {
+        int id = Index(*def);
+        if (assigned_[id] >= 0) {
+          *def = assigned_[id];
+        } else {
+          *def = RV_T0;
+          spill_offset = spill_offsets_[id];
+        }
+      }
+      // 两端分到同一个寄存器的 mv 不再需要
+      if (inst.op == MachineOp::MV && inst.rd == inst.rs1 && spill_offset < 0) continue;
+      rewritten.push_back(inst);
+      if (spill_offset >= 0) EmitStackStore(rewritten, RV_T0, spill_offset, RV_T1);
+    }
+    insts_.swap(rewritten);
+  }
+
+  void LayoutFrame() {
+    std::vector<bool> used(RV_REG_COUNT);
+    for (int reg : assigned_) {
+      if (reg >= 0) used[reg] = true;
+    }
+    int offset = func_.frame_bytes;
+    for (int reg = 0; reg < RV_REG_COUNT; reg ++) {
+      if (used[reg] && IsCalleeSaved(reg)) {
+        result_.saved_regs.push_back(reg);
+        result_.saved_offsets.push_back(offset);
+        offset += 4;
+      }
+    }
+    result_.frame_size = (offset + 15) / 16 * 16;
+  }
+};
+
+}  // namespace
+
+RegisterAllocation AllocateRegisters(MachineFunction &func) {
+  TRACE(REGALLOC, 1, "function " << func.name << ": " << func.insts.size() << " instructions, "
+        << func.next_vreg - kFirstVirtualReg << " virtual registers");
+  LinearScan scan(func);
+  return scan.Run();
+}
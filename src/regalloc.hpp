@@ -0,0 +1,22 @@
+#ifndef __REGALLOC_HPP__
+#define __REGALLOC_HPP__
+
+#include <vector>
+#include "mir.hpp"
+
+// 一个函数的寄存器分配结果, 生成 prologue/epilogue 时使用
+struct RegisterAllocation {
+  // 用到的被调用者保存寄存器, 以及它们在栈帧中的保存位置
+  std::vector<int> saved_regs;
+  std::vector<int> saved_offsets;
+  // 16 字节对齐的栈帧大小
+  int frame_size = 0;
+};
+
+// 在机器指令上做基于活跃区间的线性扫描寄存器分配, 把所有虚拟寄存器改写成物理寄存器
+// 溢出的虚拟寄存器放在 func.frame_bytes 之后的栈槽里, 每次读之前用 lw 加载到 t0/t1, 写之后用 sw 存回
+// t0/t1 保留给溢出代码, 其余 t/a/s 寄存器都参与分配
+// 指令选择只在 ret 之前直接写物理寄存器 (a0), 此时没有其他活跃的虚拟寄存器
+RegisterAllocation AllocateRegisters(MachineFunction &func);
+
+#endif
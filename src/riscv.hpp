@@ -0,0 +1,36 @@
+#ifndef __RISCV_HPP__
+#define __RISCV_HPP__
+
+// RISC-V 整数寄存器, 数值就是 x0 ~ x31 的编号
+enum RiscvReg {
+  RV_ZERO = 0,
+  RV_RA, RV_SP, RV_GP, RV_TP,
+  RV_T0, RV_T1, RV_T2,
+  RV_S0, RV_S1,
+  RV_A0, RV_A1, RV_A2, RV_A3, RV_A4, RV_A5, RV_A6, RV_A7,
+  RV_S2, RV_S3, RV_S4, RV_S5, RV_S6, RV_S7, RV_S8, RV_S9, RV_S10, RV_S11,
+  RV_T3, RV_T4, RV_T5, RV_T6,
+  RV_REG_COUNT
+};
+
+inline const char* RiscvRegName(int reg) {
+  static const char *names[RV_REG_COUNT] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5", "a6", "a7",
+    "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11",
+    "t3", "t4", "t5", "t6"
+  };
+  return names[reg];
+}
+
+// 被调用者保存的寄存器, 用到时需要在 prologue/epilogue 中保存/恢复
+inline bool IsCalleeSaved(int reg) {
+  return reg == RV_S0 || reg == RV_S1 || (reg >= RV_S2 && reg <= RV_S11);
+}
+
+// I-type 指令的立即数范围
+inline bool FitsImm12(int value) {
+  return value >= -2048 && value <= 2047;
+}
+
+#endif
@@ -0,0 +1,252 @@
+#include <algorithm>
+#include <map>
+#include <queue>
+#include <vector>
+#include "schedule.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// generic 是一组中等的数值; rocket 和 u74 是对相应处理器的粗略近似 (乘除法按最坏情况)
+const SchedModel kSchedModels[] = {
+  {"generic", 1, 3, 4, 20, 2},
+  {"rocket", 1, 3, 8, 33, 3},
+  {"u74", 1, 3, 3, 34, 4},
+};
+
+// 按给定顺序单发射时, 从第一条指令发射到最后一条指令发射之后的周期数
+// order 中是 insts 的下标, 标号不占周期
+size_t EstimateCycles(const std::vector<MachineInst> &insts, const std::vector<size_t> &order,
+                      const SchedModel &model) {
+  // 每个物理寄存器的结果可以使用的周期
+  size_t ready[RV_REG_COUNT] = {};
+  size_t cycle = 0;
+  for (size_t i : order) {
+    const MachineInst &inst = insts[i];
+    if (inst.IsLabel()) continue;
+    uint32_t uses = inst.Uses();
+    for (int reg = 0; reg < RV_REG_COUNT; reg ++) {
+      if (uses >> reg & 1) cycle = std::max(cycle, ready[reg]);
+    }
+    int def = inst.Def();
+    if (def >= 0) ready[def] = cycle + model.Latency(inst);
+    cycle ++;
+  }
+  return cycle;
+}
+
+struct DepEdge {
+  size_t to;
+  int latency;
+};
+
+// 一个基本块内的依赖图和调度, 节点编号是指令在块内去掉开头标号之后的位置
+class BlockScheduler {
+ public:
+  BlockScheduler(const std::vector<MachineInst> &insts, size_t begin, size_t end,
+                 const SchedModel &model)
+      : insts_(insts), begin_(begin), size_(end - begin), model_(model), succs_(size_),
+        pred_counts_(size_) {}
+
+  // 返回新的顺序 (insts 中的下标)
+  std::vector<size_t> Run() {
+    BuildGraph();
+    ComputeHeights();
+    return Schedule();
+  }
+
+ private:
+  const MachineInst& Inst(size_t node) const { return insts_[begin_ + node]; }
+
+  void AddEdge(size_t from, size_t to, int latency) {
+    if (from == to) return;
+    succs_[from].push_back({to, latency});
+    pred_counts_[to] ++;
+  }
+
+  void BuildGraph();
+  void AddMemoryEdges(size_t node);
+  void ComputeHeights();
+  std::vector<size_t> Schedule();
+
+  const std::vector<MachineInst> &insts_;
+  size_t begin_;
+  size_t size_;
+  const SchedModel &model_;
+  std::vector<std::vector<DepEdge>> succs_;
+  std::vector<int> pred_counts_;
+  // 从节点到块尾的最长延迟路径, 越长越优先
+  std::vector<int> heights_;
+
+  // 建图时的状态: 每个寄存器最后一次写入的节点, 以及之后读取它的节点
+  long last_def_[RV_REG_COUNT];
+  std::vector<size_t> readers_[RV_REG_COUNT];
+  // 以 sp 为基址的栈槽按偏移区分, 每个偏移上最后一次写入和之后的读取
+  struct SlotAccess {
+    long last_store = -1;
+    std::vector<size_t> loads;
+  };
+  std::map<int32_t, SlotAccess> slots_;
+  // 地址不是 sp + 常量的访存和所有访存都有依赖, 当作屏障; 上一个屏障之后的所有访存
+  long barrier_ = -1;
+  std::vector<size_t> since_barrier_;
+};
+
+void BlockScheduler::BuildGraph() {
+  std::fill(std::begin(last_def_), std::end(last_def_), -1);
+  for (size_t node = 0; node < size_; node ++) {
+    const MachineInst &inst = Inst(node);
+    // 读: 依赖上一次写入, 延迟是写入指令的延迟
+    uint32_t uses = inst.Uses();
+    for (int reg = 0; reg < RV_REG_COUNT; reg ++) {
+      if (!(uses >> reg & 1)) continue;
+      if (last_def_[reg] >= 0) {
+        AddEdge(last_def_[reg], node, model_.Latency(Inst(last_def_[reg])));
+      }
+      readers_[reg].push_back(node);
+    }
+    // 写: 排在上一次写入和之后所有读取的后面
+    int def = inst.Def();
+    if (def >= 0) {
+      if (last_def_[def] >= 0) AddEdge(last_def_[def], node, 0);
+      for (size_t reader : readers_[def]) AddEdge(reader, node, 0);
+      last_def_[def] = node;
+      readers_[def].clear();
+    }
+    if (inst.op == MachineOp::LW || inst.op == MachineOp::SW) AddMemoryEdges(node);
+    // 块尾的跳转/分支/ret 排在所有指令之后
+    if (inst.IsTerminator()) {
+      for (size_t prev = 0; prev < node; prev ++) AddEdge(prev, node, 0);
+    }
+  }
+}
+
+void BlockScheduler::AddMemoryEdges(size_t node) {
+  const MachineInst &inst = Inst(node);
+  bool is_store = inst.op == MachineOp::SW;
+  if (inst.rs1 != RV_SP) {
+    for (size_t prev : since_barrier_) AddEdge(prev, node, 0);
+    if (barrier_ >= 0) AddEdge(barrier_, node, 0);
+    barrier_ = node;
+    since_barrier_.clear();
+    slots_.clear();
+    return;
+  }
+  // sp 的修改通过寄存器依赖排好了顺序, 所以只需要比较同一个 sp 下的偏移
+  if (barrier_ >= 0) AddEdge(barrier_, node, 0);
+  since_barrier_.push_back(node);
+  SlotAccess &slot = slots_[inst.imm];
+  if (slot.last_store >= 0) AddEdge(slot.last_store, node, is_store ? 0 : 1);
+  if (is_store) {
+    for (size_t load : slot.loads) AddEdge(load, node, 0);
+    slot.last_store = node;
+    slot.loads.clear();
+  } else {
+    slot.loads.push_back(node);
+  }
+}
+
+void BlockScheduler::ComputeHeights() {
+  heights_.assign(size_, 0);
+  // 边总是从前面的节点指向后面的节点
+  for (size_t node = size_; node -- > 0; ) {
+    int height = Inst(node).IsTerminator() ? 0 : model_.Latency(Inst(node));
+    for (const DepEdge &edge : succs_[node]) {
+      height = std::max(height, edge.latency + heights_[edge.to]);
+    }
+    heights_[node] = height;
+  }
+}
+
+std::vector<size_t> BlockScheduler::Schedule() {
+  // 可以发射的节点: 高度大的优先, 相同时保持原来的顺序
+  auto lower_priority = [this](size_t a, size_t b) {
+    if (heights_[a] != heights_[b]) return heights_[a] < heights_[b];
+    return a > b;
+  };
+  std::priority_queue<size_t, std::vector<size_t>, decltype(lower_priority)> available(lower_priority);
+  // 依赖都已发射, 但操作数还没有就绪的节点, 按就绪的周期排列
+  using Pending = std::pair<size_t, size_t>;
+  std::priority_queue<Pending, std::vector<Pending>, std::greater<Pending>> pending;
+  std::vector<size_t> earliest(size_, 0);
+  for (size_t node = 0; node < size_; node ++) {
+    if (pred_counts_[node] == 0) pending.push({0, node});
+  }
+
+  std::vector<size_t> order;
+  order.reserve(size_);
+  size_t cycle = 0;
+  while (order.size() < size_) {
+    while (!pending.empty() && pending.top().first <= cycle) {
+      available.push(pending.top().second);
+      pending.pop();
+    }
+    if (available.empty()) {
+      // 停顿到下一条指令就绪
+      cycle = pending.top().first;
+      continue;
+    }
+    size_t node = available.top();
+    available.pop();
+    order.push_back(begin_ + node);
+    for (const DepEdge &edge : succs_[node]) {
+      earliest[edge.to] = std::max(earliest[edge.to], cycle + edge.latency);
+      if (-- pred_counts_[edge.to] == 0) pending.push({earliest[edge.to], edge.to});
+    }
+    cycle ++;
+  }
+  return order;
+}
+
+}  // namespace
+
+int SchedModel::Latency(const MachineInst &inst) const {
+  switch (inst.op) {
+    case MachineOp::LW:
+      return load;
+    case MachineOp::MUL:
+    case MachineOp::MULH:
+      return mul;
+    case MachineOp::DIV:
+    case MachineOp::REM:
+      return div;
+    default:
+      return alu;
+  }
+}
+
+const SchedModel* FindSchedModel(const std::string &name) {
+  for (const SchedModel &model : kSchedModels) {
+    if (name == model.name) return &model;
+  }
+  return nullptr;
+}
+
+ScheduleStats ScheduleInstructions(MachineFunction &func, const SchedModel &model) {
+  ScheduleStats stats;
+  MachineCFG cfg = BuildMachineCFG(func);
+  std::vector<MachineInst> scheduled;
+  scheduled.reserve(func.insts.size());
+  for (size_t b = 0; b < cfg.Size(); b ++) {
+    size_t begin = cfg.starts[b], end = cfg.ends[b];
+    if (func.insts[begin].IsLabel()) scheduled.push_back(func.insts[begin ++]);
+    std::vector<size_t> original(end - begin);
+    for (size_t i = begin; i < end; i ++) original[i - begin] = i;
+    std::vector<size_t> order = BlockScheduler(func.insts, begin, end, model).Run();
+    size_t before = EstimateCycles(func.insts, original, model);
+    size_t after = EstimateCycles(func.insts, order, model);
+    // 调度的优先级只是启发式的, 没有变好时保留原来的顺序
+    if (after >= before) {
+      order.swap(original);
+      after = before;
+    }
+    TRACE(SCHED, 2, "block " << b << ": " << before << " -> " << after << " cycles");
+    for (size_t i : order) scheduled.push_back(func.insts[i]);
+    stats.cycles_before += before;
+    stats.cycles_after += after;
+  }
+  func.insts.swap(scheduled);
+  TRACE(SCHED, 1, func.name << " (" << model.name << "): " << stats.cycles_before << " -> "
+        << stats.cycles_after << " cycles");
+  return stats;
+}
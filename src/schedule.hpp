@@ -0,0 +1,37 @@
+#ifndef __SCHEDULE_HPP__
+#define __SCHEDULE_HPP__
+
+#include <cstddef>
+#include <string>
+#include "mir.hpp"
+
+// 指令调度用的延迟模型: 每类指令从发射到结果可以被后面的指令使用所需的周期数
+// 按单发射顺序流水线估算, 一个周期最多发射一条指令, 操作数没有就绪时停顿
+struct SchedModel {
+  const char *name;
+  int alu;
+  int load;
+  int mul;
+  int div;
+  // 跳转和成立的分支额外损失的周期数, 调度不移动跳转, 只有模拟器 (src/simulator.hpp) 用到
+  int branch;
+
+  int Latency(const MachineInst &inst) const;
+};
+
+// 按名字查找内置的延迟模型 (generic, rocket, u74), 没有时返回 nullptr
+const SchedModel* FindSchedModel(const std::string &name);
+
+// 按延迟模型估算的周期数, 每个基本块执行一次, 不考虑分支的代价
+struct ScheduleStats {
+  size_t cycles_before = 0;
+  size_t cycles_after = 0;
+};
+
+// 在每个基本块内做表调度 (list scheduling), 重排指令以减少停顿
+// 在寄存器分配之后运行, 只在物理寄存器和栈槽的依赖 (读后写, 写后读, 写后写) 允许时移动指令,
+// 所以不会延长任何寄存器的活跃范围, 也不需要新的寄存器; 标号留在块首, 跳转/分支/ret 留在块尾
+// 只有估算的周期数减少时才采用新的顺序
+ScheduleStats ScheduleInstructions(MachineFunction &func, const SchedModel &model);
+
+#endif
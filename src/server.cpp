@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+#include "compile_context.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "source_buffer.hpp"
+
+namespace {
+
+// 随请求发送的源程序 (=N) 的大小上限, 超过时返回错误, 避免一个请求就申请任意大的内存
+const unsigned long long kMaxSourceSize = 256ull << 20;
+
+// 在请求之间保留的状态
+struct ServerState {
+  explicit ServerState(const CompileOptions &defaults, const std::string &report)
+      : defaults(defaults), report(report), sink(nullptr, 1 << 20) {}
+
+  CompileOptions defaults;
+  std::string report;
+  CompileContext cc;
+  OutputSink sink;
+  // 请求行, 以及拆分后的各个字段
+  std::string line;
+  std::vector<std::string> args;
+  // 随请求发送的源程序
+  std::string source;
+  // 交给 lexer 的源程序, 内存中的源程序复制进来, 文件则直接映射
+  SourceBuffer buffer;
+  // 输出为 - 时的编译结果
+  std::string result;
+  // 每个请求的耗时, 单位秒
+  std::vector<double> latencies;
+  size_t failed = 0;
+};
+
+// 读一行, 不包括换行符. 遇到 EOF 且什么都没读到时返回 false
+bool ReadLine(FILE *in, std::string &line) {
+  line.clear();
+  int c;
+  while ((c = getc(in)) != EOF && c != '\n') line.push_back(c);
+  if (!line.empty() && line.back() == '\r') line.pop_back();
+  return c != EOF || !line.empty();
+}
+
+// 跳过输入中的 n 个字节, 遇到 EOF 时返回 false
+bool SkipBytes(FILE *in, unsigned long long n) {
+  char buffer[4096];
+  while (n > 0) {
+    size_t chunk = n < sizeof(buffer) ? n : sizeof(buffer);
+    if (fread(buffer, 1, chunk, in) != chunk) return false;
+    n -= chunk;
+  }
+  return true;
+}
+
+void SplitArgs(const std::string &line, std::vector<std::string> &args) {
+  args.clear();
+  size_t i = 0;
+  while (i < line.size()) {
+    while (i < line.size() && isspace((unsigned char)line[i])) i ++;
+    size_t start = i;
+    while (i < line.size() && !isspace((unsigned char)line[i])) i ++;
+    if (i > start) args.push_back(line.substr(start, i - start));
+  }
+}
+
+// 处理一个编译请求, 源程序 (如果有) 已经读进 state.source
+bool HandleRequest(ServerState &state, std::string &error) {
+  const auto &args = state.args;
+  if (args.size() < 3) {
+    error = "expected: <mode> <input> <output> [options...]";
+    return false;
+  }
+  CompileOptions options = state.defaults;
+  options.mode = args[0];
+  if (options.mode != "-koopa" && options.mode != "-riscv" && options.mode != "-elf" &&
+      options.mode != "-sim") {
+    error = "unknown mode: " + options.mode;
+    return false;
+  }
+  for (size_t i = 3; i < args.size(); i ++) {
+    if (args[i] == "-O0" || args[i] == "-O1") {
+      options.opt_level = args[i][2] - '0';
+    } else {
+      error = "unknown option: " + args[i];
+      return false;
+    }
+  }
+
+  const std::string &input = args[1];
+  const std::string &output = args[2];
+  const char *name;
+  if (input[0] == '=') {
+    name = "<source>";
+    state.buffer.Assign(state.source.data(), state.source.size());
+  } else {
+    name = input.c_str();
+    if (!state.buffer.Open(name)) {
+      error = "cannot open input file: " + input;
+      return false;
+    }
+  }
+  FILE *outf = nullptr;
+  if (output == "-") {
+    state.result.clear();
+    state.sink.Capture(&state.result);
+  } else {
+    outf = fopen(output.c_str(), "w");
+    if (!outf) {
+      error = "cannot open output file: " + output;
+      return false;
+    }
+    state.sink.Reset(outf);
+  }
+
+  state.cc.Reset(name);
+  PassTimer timer;
+  bool ok = CompileSource(options, state.buffer, state.cc, state.sink, timer, error);
+  // 切回空输出, 把缓冲区中的内容写进文件/结果之后才能关闭文件
+  state.sink.Capture(nullptr);
+  if (outf) fclose(outf);
+  // 出错时已经生成的部分输出没有意义
+  if (!ok) state.result.clear();
+  return ok;
+}
+
+void ReportRequest(const ServerState &state, bool ok, double seconds, uint64_t allocs) {
+  size_t index = state.latencies.size();
+  if (state.report == "text") {
+    fprintf(stderr, "request %zu: %s, %.3f ms, %llu allocs\n", index,
+            ok ? "ok" : "error", seconds * 1000, (unsigned long long)allocs);
+  } else if (state.report == "json") {
+    fprintf(stderr, "{\"request\": %zu, \"ok\": %s, \"seconds\": %.6f, \"allocs\": %llu}\n",
+            index, ok ? "true" : "false", seconds, (unsigned long long)allocs);
+  }
+}
+
+void ReportSummary(const ServerState &state) {
+  if (state.report.empty()) return;
+  std::vector<double> sorted = state.latencies;
+  std::sort(sorted.begin(), sorted.end());
+  double total = 0;
+  for (double seconds : sorted) total += seconds;
+  double mean = sorted.empty() ? 0 : total / sorted.size();
+  double median = sorted.empty() ? 0 : sorted[sorted.size() / 2];
+  double max = sorted.empty() ? 0 : sorted.back();
+  if (state.report == "text") {
+    fprintf(stderr, "serve: %zu requests, %zu failed, mean %.3f ms, p50 %.3f ms, max %.3f ms\n",
+            sorted.size(), state.failed, mean * 1000, median * 1000, max * 1000);
+  } else {
+    fprintf(stderr, "{\"requests\": %zu, \"failed\": %zu, \"mean\": %.6f, \"p50\": %.6f, "
+            "\"max\": %.6f}\n", sorted.size(), state.failed, mean, median, max);
+  }
+}
+
+enum class SessionEnd { CLOSED, SHUTDOWN };
+
+// 在一个连接上依次处理请求, 直到对端关闭, quit 或 shutdown
+SessionEnd ServeConnection(ServerState &state, FILE *in, FILE *out) {
+  std::string error;
+  while (ReadLine(in, state.line)) {
+    SplitArgs(state.line, state.args);
+    if (state.args.empty()) continue;
+    if (state.args.size() == 1 && state.args[0] == "quit") return SessionEnd::CLOSED;
+    if (state.args.size() == 1 && state.args[0] == "shutdown") return SessionEnd::SHUTDOWN;
+
+    auto start = std::chrono::steady_clock::now();
+    AllocStats start_alloc = GetAllocStats();
+    error.clear();
+    // 先把随请求发送的源程序读完, 即使请求的其他部分有错也不会打乱后面的请求
+    // 源程序不完整时回复这个请求之后结束连接
+    bool truncated = false;
+    if (state.args.size() >= 2 && state.args[1][0] == '=') {
+      unsigned long long len = strtoull(state.args[1].c_str() + 1, nullptr, 10);
+      if (len > kMaxSourceSize) {
+        // 不申请内存, 读出来丢掉
+        error = "source too large: " + std::to_string(len) + " bytes (limit " +
+                std::to_string(kMaxSourceSize) + ")";
+        truncated = !SkipBytes(in, len);
+      } else {
+        state.source.resize(len);
+        if (len && fread(&state.source[0], 1, len, in) != len) return SessionEnd::CLOSED;
+      }
+    }
+    state.result.clear();
+    bool ok = error.empty() && HandleRequest(state, error);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long long micros = (long long)(seconds * 1e6);
+    if (ok) {
+      fprintf(out, "ok %lld %zu\n", micros, state.result.size());
+      fwrite(state.result.data(), 1, state.result.size(), out);
+    } else {
+      // 错误信息只占一行
+      std::replace(error.begin(), error.end(), '\n', ' ');
+      fprintf(out, "error %lld %s\n", micros, error.c_str());
+      state.failed ++;
+    }
+    fflush(out);
+    state.latencies.push_back(seconds);
+    ReportRequest(state, ok, seconds, GetAllocStats().count - start_alloc.count);
+    if (truncated) break;
+  }
+  return SessionEnd::CLOSED;
+}
+
+int ServeSocket(ServerState &state, const std::string &path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "socket path too long: %s\n", path.c_str());
+    return 1;
+  }
+  strcpy(addr.sun_path, path.c_str());
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return 1;
+  }
+  unlink(path.c_str());
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+    perror(path.c_str());
+    close(fd);
+    return 1;
+  }
+  // 客户端提前断开时写响应不应该杀死整个服务
+  signal(SIGPIPE, SIG_IGN);
+
+  SessionEnd end = SessionEnd::CLOSED;
+  while (end != SessionEnd::SHUTDOWN) {
+    int conn = accept(fd, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno == EINTR) continue;
+      perror("accept");
+      break;
+    }
+    FILE *in = fdopen(conn, "r");
+    FILE *out = fdopen(dup(conn), "w");
+    end = ServeConnection(state, in, out);
+    fclose(out);
+    fclose(in);
+  }
+  close(fd);
+  unlink(path.c_str());
+  return 0;
+}
+
+}  // namespace
+
+int RunServer(const CompileOptions &defaults, const std::string &socket_path,
+              const std::string &report) {
+  ServerState state(defaults, report);
+  int ret = 0;
+  if (socket_path.empty()) {
+    ServeConnection(state, stdin, stdout);
+  } else {
+    ret = ServeSocket(state, socket_path);
+  }
+  ReportSummary(state);
+  return ret;
+}
@@ -0,0 +1,25 @@
+#ifndef __SERVER_HPP__
+#define __SERVER_HPP__
+
+#include "driver.hpp"
+
+// -serve: 常驻进程, 连续处理编译请求, 省掉每个文件的进程启动和动态链接开销
+// Arena, 字符串表, 表达式池和输出缓冲区在请求之间复用
+//
+// 协议 (基于行, stdin/stdout 或 Unix socket 上的每个连接):
+//   请求: 模式 输入 输出 [选项...]
+//     模式是 -koopa, -riscv, -elf 或 -sim
+//     输入是文件路径, 或者 =N, 表示请求行之后紧跟 N 字节的源程序
+//     (N 最大 256MB, 超过时跳过这些字节, 返回 error)
+//     输出是文件路径, 或者 -, 表示结果随响应返回
+//     选项目前只有 -O0/-O1, 不写时使用启动服务时的设置
+//   响应: ok 耗时(微秒) N, 之后紧跟 N 字节的输出 (写到文件时 N 为 0)
+//         error 耗时(微秒) 错误信息
+//   quit 结束当前连接, shutdown 结束整个服务
+//
+// socket_path 为空时使用 stdin/stdout, 否则监听该路径上的 Unix socket, 依次处理每个连接
+// report 是 -time-passes 的格式 (text 或 json), 非空时在 stderr 上输出每个请求的耗时和结束时的汇总
+int RunServer(const CompileOptions &defaults, const std::string &socket_path,
+              const std::string &report);
+
+#endif
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "riscv.hpp"
+#include "simulator.hpp"
+
+namespace {
+
+// 地址空间: .text 从 kTextBase 开始, 栈在 kStackTop 之下, main 返回到 kReturnAddress 时结束
+constexpr uint32_t kTextBase = 0x10000;
+constexpr uint32_t kStackTop = 0x80000000;
+constexpr uint32_t kReturnAddress = 0;
+
+// 在 ELF 文件中按偏移读取小端序的整数, 越界时报错
+class ElfReader {
+ public:
+  ElfReader(const char *data, size_t size) : data_(data), size_(size) {}
+
+  uint32_t U8(size_t offset) const { return (uint8_t)Bytes(offset, 1)[0]; }
+  uint32_t U16(size_t offset) const { return U8(offset) | U8(offset + 1) << 8; }
+  uint32_t U32(size_t offset) const { return U16(offset) | U16(offset + 2) << 16; }
+  const char* Bytes(size_t offset, size_t len) const {
+    if (offset > size_ || len > size_ - offset) throw std::string("truncated object file");
+    return data_ + offset;
+  }
+  // 以 '\0' 结尾的字符串
+  std::string String(size_t offset) const {
+    std::string str;
+    for (char c; (c = (char)U8(offset)) != '\0'; offset ++) str.push_back(c);
+    return str;
+  }
+
+ private:
+  const char *data_;
+  size_t size_;
+};
+
+struct Section {
+  std::string name;
+  uint32_t type, offset, size, link;
+};
+
+// 从目标文件中取出 .text 和 main 在其中的偏移
+void LoadObject(const char *object, size_t size, std::vector<uint8_t> &text, uint32_t &entry) {
+  ElfReader elf(object, size);
+  if (memcmp(elf.Bytes(0, 4), "\x7f" "ELF", 4) != 0) throw std::string("not an ELF file");
+  // ELFCLASS32, 小端序, EM_RISCV
+  if (elf.U8(4) != 1 || elf.U8(5) != 1 || elf.U16(18) != 243) {
+    throw std::string("not a little-endian RV32 object file");
+  }
+  uint32_t shoff = elf.U32(32);
+  uint32_t shentsize = elf.U16(46), shnum = elf.U16(48), shstrndx = elf.U16(50);
+  std::vector<Section> sections(shnum);
+  for (uint32_t i = 0; i < shnum; i ++) {
+    size_t header = shoff + (size_t)i * shentsize;
+    sections[i] = {"", elf.U32(header + 4), elf.U32(header + 16), elf.U32(header + 20),
+                   elf.U32(header + 24)};
+  }
+  if (shstrndx >= shnum) throw std::string("bad section name table");
+  for (uint32_t i = 0; i < shnum; i ++) {
+    size_t header = shoff + (size_t)i * shentsize;
+    sections[i].name = elf.String(sections[shstrndx].offset + elf.U32(header));
+  }
+
+  // SHT_SYMTAB = 2, SHT_RELA = 4
+  int text_index = -1;
+  const Section *symtab = nullptr;
+  for (uint32_t i = 0; i < shnum; i ++) {
+    if (sections[i].name == ".text") text_index = i;
+    if (sections[i].type == 2) symtab = &sections[i];
+    if (sections[i].type == 4 && sections[i].size != 0) {
+      throw std::string("relocations are not supported");
+    }
+  }
+  if (text_index < 0 || !symtab || symtab->link >= shnum) {
+    throw std::string("object file has no .text or symbol table");
+  }
+  const Section &text_section = sections[text_index];
+  const char *bytes = elf.Bytes(text_section.offset, text_section.size);
+  text.assign(bytes, bytes + text_section.size);
+
+  const Section &strtab = sections[symtab->link];
+  for (uint32_t offset = 0; offset + 16 <= symtab->size; offset += 16) {
+    size_t symbol = symtab->offset + offset;
+    if (elf.U16(symbol + 14) != (uint32_t)text_index) continue;
+    if (elf.String(strtab.offset + elf.U32(symbol)) == "main") {
+      entry = elf.U32(symbol + 4);
+      return;
+    }
+  }
+  throw std::string("main is not defined");
+}
+
+class Machine {
+ public:
+  Machine(std::vector<uint8_t> text, const SimOptions &options)
+      : text_(std::move(text)), options_(options), model_(*options.model),
+        stack_(options.stack_bytes) {}
+
+  SimResult Run(uint32_t entry);
+
+ private:
+  uint32_t Fetch(uint32_t pc) const {
+    uint32_t offset = pc - kTextBase;
+    if (pc < kTextBase || offset > text_.size() || text_.size() - offset < 4 || pc % 4) {
+      throw std::string("jump to invalid address ") + std::to_string(pc);
+    }
+    uint32_t inst;
+    memcpy(&inst, text_.data() + offset, 4);
+    return inst;
+  }
+
+  // 栈中 [address, address + len) 对应的内存
+  uint8_t* Memory(uint32_t address, uint32_t len) {
+    uint32_t stack_base = kStackTop - stack_.size();
+    if (address < stack_base || address > kStackTop - len) {
+      throw std::string("memory access out of stack at ") + std::to_string(address);
+    }
+    return stack_.data() + (address - stack_base);
+  }
+
+  // 读寄存器 reg, 同时记下它的值什么时候可以用
+  uint32_t Read(uint32_t reg) {
+    issue_ = std::max(issue_, ready_[reg]);
+    return regs_[reg];
+  }
+  void Write(uint32_t reg, uint32_t value, int latency) {
+    if (reg == RV_ZERO) return;
+    regs_[reg] = value;
+    // 此时操作数已经全部读过, issue_ 就是这条指令发射的周期
+    ready_[reg] = issue_ + latency;
+  }
+
+  // 执行一条指令, 返回下一条指令的地址
+  uint32_t Step(uint32_t pc, uint32_t inst);
+  [[noreturn]] void Illegal(uint32_t pc, uint32_t inst) const {
+    throw std::string("illegal instruction ") + std::to_string(inst) + " at " + std::to_string(pc);
+  }
+
+  std::vector<uint8_t> text_;
+  const SimOptions &options_;
+  const SchedModel &model_;
+  std::vector<uint8_t> stack_;
+  uint32_t regs_[RV_REG_COUNT] = {};
+  // 每个寄存器的值可以被使用的周期
+  uint64_t ready_[RV_REG_COUNT] = {};
+  // 当前指令最早可以发射的周期
+  uint64_t issue_ = 0;
+};
+
+SimResult Machine::Run(uint32_t entry) {
+  regs_[RV_RA] = kReturnAddress;
+  regs_[RV_SP] = kStackTop;
+  SimResult result;
+  uint32_t pc = kTextBase + entry;
+  while (pc != kReturnAddress) {
+    if (result.instructions == options_.max_instructions) {
+      throw std::string("instruction limit exceeded");
+    }
+    uint32_t next = Step(pc, Fetch(pc));
+    result.instructions ++;
+    // 下一条指令最早在下一个周期发射, 控制流改变时还要等取指
+    issue_ ++;
+    if (next != pc + 4) issue_ += model_.branch;
+    pc = next;
+  }
+  result.exit_value = regs_[RV_A0];
+  result.cycles = issue_;
+  return result;
+}
+
+// 符号扩展 value 的低 bits 位
+int32_t SignExtend(uint32_t value, int bits) {
+  return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+uint32_t Machine::Step(uint32_t pc, uint32_t inst) {
+  uint32_t opcode = inst & 0x7f;
+  uint32_t rd = inst >> 7 & 0x1f, funct3 = inst >> 12 & 7;
+  uint32_t rs1 = inst >> 15 & 0x1f, rs2 = inst >> 20 & 0x1f, funct7 = inst >> 25;
+  int32_t imm_i = (int32_t)inst >> 20;
+  int32_t imm_s = SignExtend((inst >> 25) << 5 | (inst >> 7 & 0x1f), 12);
+  int32_t imm_b = SignExtend((inst >> 31) << 12 | (inst >> 7 & 1) << 11 | (inst >> 25 & 0x3f) << 5 |
+                             (inst >> 8 & 0xf) << 1, 13);
+  int32_t imm_j = SignExtend((inst >> 31) << 20 | (inst >> 12 & 0xff) << 12 |
+                             (inst >> 20 & 1) << 11 | (inst >> 21 & 0x3ff) << 1, 21);
+  switch (opcode) {
+    case 0x37:  // lui
+      Write(rd, inst & 0xfffff000, model_.alu);
+      return pc + 4;
+    case 0x17:  // auipc
+      Write(rd, pc + (inst & 0xfffff000), model_.alu);
+      return pc + 4;
+    case 0x6f:  // jal
+      Write(rd, pc + 4, model_.alu);
+      return pc + imm_j;
+    case 0x67: {  // jalr
+      if (funct3 != 0) Illegal(pc, inst);
+      uint32_t target = (Read(rs1) + imm_i) & ~1u;
+      Write(rd, pc + 4, model_.alu);
+      return target;
+    }
+    case 0x63: {  // 条件分支
+      uint32_t a = Read(rs1), b = Read(rs2);
+      bool taken;
+      switch (funct3) {
+        case 0: taken = a == b; break;
+        case 1: taken = a != b; break;
+        case 4: taken = (int32_t)a < (int32_t)b; break;
+        case 5: taken = (int32_t)a >= (int32_t)b; break;
+        case 6: taken = a < b; break;
+        case 7: taken = a >= b; break;
+        default: Illegal(pc, inst);
+      }
+      return taken ? pc + imm_b : pc + 4;
+    }
+    case 0x03: {  // 读内存
+      uint32_t address = Read(rs1) + imm_i;
+      uint32_t value;
+      switch (funct3) {
+        case 0: value = SignExtend(*Memory(address, 1), 8); break;
+        case 1: {
+          uint16_t half;
+          memcpy(&half, Memory(address, 2), 2);
+          value = SignExtend(half, 16);
+          break;
+        }
+        case 2: memcpy(&value, Memory(address, 4), 4); break;
+        case 4: value = *Memory(address, 1); break;
+        case 5: {
+          uint16_t half;
+          memcpy(&half, Memory(address, 2), 2);
+          value = half;
+          break;
+        }
+        default: Illegal(pc, inst);
+      }
+      Write(rd, value, model_.load);
+      return pc + 4;
+    }
+    case 0x23: {  // 写内存
+      uint32_t address = Read(rs1) + imm_s;
+      uint32_t value = Read(rs2);
+      switch (funct3) {
+        case 0: memcpy(Memory(address, 1), &value, 1); break;
+        case 1: memcpy(Memory(address, 2), &value, 2); break;
+        case 2: memcpy(Memory(address, 4), &value, 4); break;
+        default: Illegal(pc, inst);
+      }
+      return pc + 4;
+    }
+    case 0x13: {  // 立即数运算
+      uint32_t a = Read(rs1), b = imm_i, shamt = rs2;
+      uint32_t value;
+      switch (funct3) {
+        case 0: value = a + b; break;
+        case 2: value = (int32_t)a < (int32_t)b; break;
+        case 3: value = a < b; break;
+        case 4: value = a ^ b; break;
+        case 6: value = a | b; break;
+        case 7: value = a & b; break;
+        case 1:
+          if (funct7 != 0) Illegal(pc, inst);
+          value = a << shamt;
+          break;
+        case 5:
+          if (funct7 == 0) {
+            value = a >> shamt;
+          } else if (funct7 == 0x20) {
+            value = (int32_t)a >> shamt;
+          } else {
+            Illegal(pc, inst);
+          }
+          break;
+        default: Illegal(pc, inst);
+      }
+      Write(rd, value, model_.alu);
+      return pc + 4;
+    }
+    case 0x33: {  // 寄存器运算
+      uint32_t a = Read(rs1), b = Read(rs2);
+      int32_t sa = a, sb = b;
+      uint32_t value;
+      int latency = model_.alu;
+      if (funct7 == 1) {
+        // M 扩展, 除以 0 和溢出的结果按规范定义, 不会产生异常
+        latency = funct3 < 4 ? model_.mul : model_.div;
+        switch (funct3) {
+          case 0: value = a * b; break;
+          case 1: value = (uint64_t)((int64_t)sa * sb) >> 32; break;
+          case 2: value = (uint64_t)((int64_t)sa * (uint64_t)b) >> 32; break;
+          case 3: value = (uint64_t)a * b >> 32; break;
+          case 4: value = b == 0 ? ~0u : (sa == INT32_MIN && sb == -1) ? a : (uint32_t)(sa / sb); break;
+          case 5: value = b == 0 ? ~0u : a / b; break;
+          case 6: value = b == 0 ? a : (sa == INT32_MIN && sb == -1) ? 0 : (uint32_t)(sa % sb); break;
+          default: value = b == 0 ? a : a % b; break;
+        }
+      } else if (funct7 == 0 || (funct7 == 0x20 && (funct3 == 0 || funct3 == 5))) {
+        switch (funct3) {
+          case 0: value = funct7 ? a - b : a + b; break;
+          case 1: value = a << (b & 0x1f); break;
+          case 2: value = sa < sb; break;
+          case 3: value = a < b; break;
+          case 4: value = a ^ b; break;
+          case 5: value = funct7 ? (uint32_t)(sa >> (b & 0x1f)) : a >> (b & 0x1f); break;
+          case 6: value = a | b; break;
+          default: value = a & b; break;
+        }
+      } else {
+        Illegal(pc, inst);
+      }
+      Write(rd, value, latency);
+      return pc + 4;
+    }
+    case 0x0f:  // fence, 只有一个 hart, 什么也不用做
+      return pc + 4;
+    default:
+      Illegal(pc, inst);
+  }
+}
+
+}  // namespace
+
+SimResult Simulate(const char *object, size_t size, const SimOptions &options) {
+  std::vector<uint8_t> text;
+  uint32_t entry = 0;
+  LoadObject(object, size, text, entry);
+  Machine machine(std::move(text), options);
+  return machine.Run(entry);
+}
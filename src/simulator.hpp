@@ -0,0 +1,33 @@
+#ifndef __SIMULATOR_HPP__
+#define __SIMULATOR_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include "schedule.hpp"
+
+// 内置的 RV32IM 解释器, 在没有 RISC-V 硬件时评估生成代码的质量
+
+struct SimOptions {
+  // 估算周期数用的延迟模型, 与指令调度共用
+  const SchedModel *model = nullptr;
+  // 执行的指令数上限, 超出时认为程序没有终止
+  uint64_t max_instructions = 1000000000;
+  // 栈的大小
+  size_t stack_bytes = 1 << 20;
+};
+
+struct SimResult {
+  // main 的返回值 (a0)
+  int32_t exit_value = 0;
+  // 动态执行的指令条数
+  uint64_t instructions = 0;
+  // 按延迟模型估算的周期数: 单发射顺序流水线, 操作数没有就绪时停顿, 跳转和成立的分支另有 model.branch 的代价
+  uint64_t cycles = 0;
+};
+
+// 加载 -elf 输出的 RV32 目标文件, 从 main 开始执行到它返回
+// 只有一个栈, 没有全局数据, 不支持需要重定位的目标文件和 ecall
+// 出错时 (格式不对, 找不到 main, 非法指令, 访问栈以外的内存, 超出指令数上限) 抛出 std::string
+SimResult Simulate(const char *object, size_t size, const SimOptions &options);
+
+#endif
@@ -0,0 +1,74 @@
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "source_buffer.hpp"
+
+bool SourceBuffer::Open(const char *path) {
+  Release();
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    close(fd);
+    return false;
+  }
+  size_t size = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t tail = size % page;
+  // 文件最后一页剩下的空间能放下末尾的 '\0' 时直接映射, 否则 (包括空文件) 读进自己的缓冲区
+  if (tail != 0 && page - tail >= kPadding) {
+    void *data = mmap(nullptr, size + kPadding, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      close(fd);
+      data_ = static_cast<char*>(data);
+      size_ = size;
+      mapped_ = size + kPadding;
+      return true;
+    }
+  }
+  owned_.resize(size + kPadding);
+  size_t done = 0;
+  while (done < size) {
+    ssize_t ret = read(fd, owned_.data() + done, size - done);
+    if (ret <= 0) break;
+    done += ret;
+  }
+  close(fd);
+  if (done != size) return false;
+  memset(owned_.data() + size, 0, kPadding);
+  data_ = owned_.data();
+  size_ = size;
+  return true;
+}
+
+void SourceBuffer::Assign(const char *data, size_t size) {
+  Release();
+  owned_.resize(size + kPadding);
+  memcpy(owned_.data(), data, size);
+  memset(owned_.data() + size, 0, kPadding);
+  data_ = owned_.data();
+  size_ = size;
+}
+
+void SourceBuffer::Release() {
+  if (mapped_) munmap(data_, mapped_);
+  data_ = nullptr;
+  size_ = 0;
+  mapped_ = 0;
+}
+
+std::string SourceLocation(const char *source, size_t size, uint32_t offset) {
+  size_t line = 1, column = 1;
+  for (size_t i = 0; i < offset && i < size; i ++) {
+    if (source[i] == '\n') {
+      line ++;
+      column = 1;
+    } else {
+      column ++;
+    }
+  }
+  return std::to_string(line) + ":" + std::to_string(column);
+}
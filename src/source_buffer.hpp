@@ -0,0 +1,55 @@
+#ifndef __SOURCE_BUFFER_HPP__
+#define __SOURCE_BUFFER_HPP__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// token 在源程序中的位置, 也是 Bison 的位置类型 (YYLTYPE)
+// 只记录偏移和长度, 行号/列号在报错时才从源程序中算出来
+struct SourceSpan {
+  uint32_t offset;
+  uint32_t length;
+};
+
+// 交给 lexer 的源程序
+// Flex 的 yy_scan_buffer 直接在这块内存上扫描, 不再把输入复制进它自己的缓冲区,
+// 要求末尾有两个 '\0', 并且内存可写 (Flex 会临时把 token 之后的字符改成 '\0')
+// 文件优先用 mmap 映射: 文件末尾所在的页中, 文件之后的部分由内核填 0, 空间足够时直接作为末尾的 '\0',
+// 映射是私有的, 写入只会让内核复制被改动的页, 不会写回文件
+class SourceBuffer {
+ public:
+  static constexpr size_t kPadding = 2;
+
+  SourceBuffer() = default;
+  SourceBuffer(const SourceBuffer&) = delete;
+  SourceBuffer& operator=(const SourceBuffer&) = delete;
+  ~SourceBuffer() { Release(); }
+
+  // 读入文件, 失败时返回 false
+  bool Open(const char *path);
+  // 复制一段内存中的源程序, 缓冲区在多次调用之间复用
+  void Assign(const char *data, size_t size);
+
+  // 源程序内容, 不包括末尾的 '\0'
+  const char* Data() const { return data_; }
+  size_t Size() const { return size_; }
+  // 交给 yy_scan_buffer 的缓冲区, 包括末尾的 '\0'
+  char* ScanBase() { return data_; }
+  size_t ScanSize() const { return size_ + kPadding; }
+
+ private:
+  void Release();
+
+  char *data_ = nullptr;
+  size_t size_ = 0;
+  // mmap 得到的映射长度, 为 0 表示数据在 owned_ 中
+  size_t mapped_ = 0;
+  std::vector<char> owned_;
+};
+
+// 把偏移转换成 "行:列" (都从 1 开始), 用于报错
+std::string SourceLocation(const char *source, size_t size, uint32_t offset);
+
+#endif
@@ -0,0 +1,27 @@
+#include <cassert>
+#include "symbol_table.hpp"
+
+void SymbolTable::PushScope() {
+  scope_starts_.push_back(entries_.size());
+}
+
+void SymbolTable::PopScope() {
+  assert(!scope_starts_.empty());
+  uint32_t start = scope_starts_.back();
+  scope_starts_.pop_back();
+  while (entries_.size() > start) {
+    const Entry &entry = entries_.back();
+    head_[entry.id] = entry.shadowed;
+    entries_.pop_back();
+  }
+}
+
+bool SymbolTable::Define(SymbolId id, const Symbol &symbol) {
+  if (id >= head_.size()) head_.resize(id + 1, -1);
+  int32_t cur = head_[id];
+  uint32_t depth = Depth();
+  if (cur >= 0 && entries_[cur].depth == depth) return false;
+  head_[id] = entries_.size();
+  entries_.push_back({id, depth, cur, symbol});
+  return true;
+}
@@ -0,0 +1,61 @@
+#ifndef __SYMBOL_TABLE_HPP__
+#define __SYMBOL_TABLE_HPP__
+
+#include <cstdint>
+#include <vector>
+#include "intern.hpp"
+#include "koopa.h"
+
+// 符号表中的一项
+struct Symbol {
+  enum class SymbolKind {
+    CONST,
+    VAR
+  };
+  SymbolKind kind;
+  // CONST: 编译期求出的值
+  int value;
+  // VAR: 变量对应的 alloc 指令
+  koopa_raw_value_t alloc;
+
+  static Symbol Const(int value) {
+    return {SymbolKind::CONST, value, nullptr};
+  }
+  static Symbol Var(koopa_raw_value_t alloc) {
+    return {SymbolKind::VAR, 0, alloc};
+  }
+};
+
+// 带作用域的符号表, 每次编译一份
+// 标识符已经被驻留成连续的 SymbolId, 所以直接用它做下标, 不需要再哈希
+// 同名符号按定义顺序压栈, 内层定义通过 shadowed 链到被遮蔽的外层定义
+class SymbolTable {
+ public:
+  // 进入作用域 O(1), 离开作用域只撤销本作用域内的定义
+  void PushScope();
+  void PopScope();
+  // 在当前作用域中定义符号, 同一作用域内重复定义时返回 false
+  bool Define(SymbolId id, const Symbol &symbol);
+  // 查找当前可见的定义, 找不到时返回 nullptr
+  const Symbol* Lookup(SymbolId id) const {
+    if (id >= head_.size() || head_[id] < 0) return nullptr;
+    return &entries_[head_[id]].symbol;
+  }
+  size_t Depth() const { return scope_starts_.size(); }
+
+ private:
+  struct Entry {
+    SymbolId id;
+    uint32_t depth;
+    int32_t shadowed;
+    Symbol symbol;
+  };
+
+  std::vector<Entry> entries_;
+  // 以 SymbolId 为下标, 指向 entries_ 中当前可见的定义, -1 表示没有
+  std::vector<int32_t> head_;
+  // 每个作用域开始时 entries_ 的大小
+  std::vector<uint32_t> scope_starts_;
+};
+
+#endif
@@ -1,72 +1,109 @@
 %code requires {
-  #include <memory>
   #include <string>
+  #include "arena.hpp"
   #include "ast.hpp"
+  #include "compile_context.hpp"
+  #include "expr_pool.hpp"
+  #include "intern.hpp"
+  #include "source_buffer.hpp"
+
+  // 位置类型是 SourceSpan, 规则的位置是从第一个符号开始到最后一个符号结束的区间
+  // 空规则的位置是前一个符号之后长度为 0 的区间
+  #define YYLLOC_DEFAULT(Current, Rhs, N)                                   \
+    do {                                                                    \
+      if (N) {                                                              \
+        (Current).offset = YYRHSLOC(Rhs, 1).offset;                         \
+        (Current).length = YYRHSLOC(Rhs, N).offset + YYRHSLOC(Rhs, N).length \
+                           - YYRHSLOC(Rhs, 1).offset;                       \
+      } else {                                                              \
+        (Current).offset = YYRHSLOC(Rhs, 0).offset + YYRHSLOC(Rhs, 0).length; \
+        (Current).length = 0;                                               \
+      }                                                                     \
+    } while (0)
 }
 
 %{
 
-#include <iostream>
-#include <memory>
 #include <string>
+#include "arena.hpp"
 #include "ast.hpp"
+#include "compile_context.hpp"
+#include "expr_pool.hpp"
+#include "intern.hpp"
+#include "trace.hpp"
 
-// 声明 lexer 函数和错误处理函数
-int yylex();
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s);
 using namespace std;
 
 %}
 
+// 声明 lexer 函数和错误处理函数
+// 放在 %code 中, 因为要用到 Bison 生成的 YYSTYPE
+%code {
+int yylex(YYSTYPE *lval, SourceSpan *lloc, yyscan_t scanner, CompileContext &cc);
+void yyerror(SourceSpan *loc, yyscan_t scanner, CompileContext &cc, const char *s);
+}
+
+// parser 和 lexer 都是可重入的, 没有全局状态, 多个线程可以同时解析不同的文件
+%define api.pure full
+
+// 每个 token 带着它在源程序中的位置 (偏移, 长度), 用于报错
+%locations
+%define api.location.type {SourceSpan}
+
 // 定义 parser 函数和错误处理函数的附加参数
-// 我们需要返回一个字符串作为 AST, 所以我们把附加参数定义成字符串的智能指针
-// 解析完成后, 我们要手动修改这个参数, 把它设置成解析得到的字符串
-%parse-param { std::unique_ptr<BaseAST> &ast }
+// 解析完成后, 我们要手动修改 cc.ast, 把它设置成解析得到的 AST 的根节点
+// 语句层面的 AST 节点分配在 cc.arena 中, 表达式节点放在 cc.exprs 中
+// 标识符由 lexer 驻留到 cc.interner 中, token 只携带 SymbolId
+%parse-param { yyscan_t scanner } { CompileContext &cc }
+%lex-param { yyscan_t scanner } { CompileContext &cc }
 
 // yylval 的定义, 我们把它定义成了一个联合体 (union)
-// 因为 token 的值有的是字符串指针, 有的是整数
-// 之前我们在 lexer 中用到的 str_val 和 int_val 就是在这里被定义的
-// 至于为什么要用字符串指针而不直接用 string 或者 unique_ptr<string>?
+// 因为 token 的值有的是标识符编号, 有的是整数
+// 之前我们在 lexer 中用到的 sym_val 和 int_val 就是在这里被定义的
+// 至于为什么不直接用 string 或者 unique_ptr<string>?
 // 请自行 STFW 在 union 里写一个带析构函数的类会出现什么情况
 %union {
-  std::string *str_val;
+  SymbolId sym_val;
   int int_val;
   BaseAST *ast_val;
+  ExprId expr_val;
 }
 
 // lexer 返回的所有 token 种类的声明
-// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 str_val 和 int_val
+// 注意 IDENT 和 INT_CONST 会返回 token 的值, 分别对应 sym_val 和 int_val
 %token INT RETURN LE GE EQ NE AND OR CONST
-%token <str_val> IDENT
+%token <sym_val> IDENT
 %token <int_val> INT_CONST
 
 // 非终结符的类型定义
-%type <ast_val> FuncDef FuncType Block Stmt Exp UnaryExp PrimaryExp UnaryOp AddExp MulExp LOrExp LAndExp EqExp RelExp BlockItems BlockItem Decl ConstDecl ConstDefs ConstDef ConstInitVal ConstExp  LVal
-%type <int_val> Number
+%type <ast_val> FuncDef FuncType Block Stmt BlockItems BlockItem Decl ConstDecl ConstDefs ConstDef
+%type <expr_val> Exp UnaryExp PrimaryExp AddExp MulExp LOrExp LAndExp EqExp RelExp ConstInitVal ConstExp LVal
+%type <int_val> Number UnaryOp
 
 %%
 
 CompUnit
   : FuncDef {
-    auto comp_unit = make_unique<CompUnitAST>();
-    comp_unit->func_def = unique_ptr<BaseAST>($1);
-    ast = move(comp_unit);
+    auto comp_unit = cc.arena.New<CompUnitAST>();
+    comp_unit->func_def = $1;
+    cc.ast = comp_unit;
   }
   ;
 
 FuncDef
   : FuncType IDENT '(' ')' Block {
-    auto ast = new FuncDefAST();
-    ast->func_type = unique_ptr<BaseAST>($1);
-    ast->ident = *unique_ptr<string>($2);
-    ast->block = unique_ptr<BaseAST>($5);
+    auto ast = cc.arena.New<FuncDefAST>();
+    ast->func_type = $1;
+    ast->ident = cc.interner.Name($2);
+    TRACE(PARSER, 1, "function " << ast->ident);
+    ast->block = $5;
     $$ = ast;
   }
   ;
 // 同上, 不再解释
 FuncType
   : INT {
-    auto ast = new FuncTypeAST();
+    auto ast = cc.arena.New<FuncTypeAST>();
     ast->type = "i32";
     $$ = ast;
   }
@@ -74,54 +111,52 @@ FuncType
 
 Block
   : '{' BlockItems '}' {
-    auto ast = new BlockAST();
-    ast->block_items = std::unique_ptr<BaseAST>($2);
-    // std::cout << "block: " << ast->Dump() << std::endl;
+    auto ast = cc.arena.New<BlockAST>();
+    ast->block_items = $2;
     $$ = ast;
   }
   ;
 
 BlockItems
   : BlockItem {
-    auto ast = new BlockItemsAST();
-    ast->block_items.push_back(std::unique_ptr<BaseAST>($1));
+    auto ast = cc.arena.New<BlockItemsAST>(cc.arena);
+    ast->block_items.push_back($1);
     $$ = ast;
   }
   | BlockItems BlockItem {
-    auto ast = new BlockItemsAST();
-    ast->block_items = std::move(((BlockItemsAST*)$1)->block_items);
-    ast->block_items.push_back(std::unique_ptr<BaseAST>($2));
-    $$ = ast;
+    // 直接追加到已有的节点上, 不再新建节点搬运 vector
+    ((BlockItemsAST*)$1)->block_items.push_back($2);
+    $$ = $1;
   }
   ;
 
 BlockItem
   : Decl {
-    BlockItemAST* ast = new BlockItemAST();
+    BlockItemAST* ast = cc.arena.New<BlockItemAST>();
     ast->type = BlockItemAST::BlockItemType::DECL;
-    ast->decl = std::unique_ptr<BaseAST>($1);
+    ast->decl = $1;
     $$ = ast;
   }
   | Stmt {
-    BlockItemAST* ast = new BlockItemAST();
+    BlockItemAST* ast = cc.arena.New<BlockItemAST>();
     ast->type = BlockItemAST::BlockItemType::STMT;
-    ast->stmt = std::unique_ptr<BaseAST>($1);
+    ast->stmt = $1;
     $$ = ast;
   }
   ;
 
 Decl
   : ConstDecl {
-    auto ast = new DeclAST();
-    ast->const_decl = std::unique_ptr<BaseAST>($1);
+    auto ast = cc.arena.New<DeclAST>();
+    ast->const_decl = $1;
     $$ = ast;
   }
   ;
 
 ConstDecl
   : CONST BType ConstDefs ';' {
-    auto ast = new ConstDeclAST();
-    ast->const_defs = std::unique_ptr<BaseAST>($3);
+    auto ast = cc.arena.New<ConstDeclAST>();
+    ast->const_defs = $3;
     $$ = ast;
   }
   ;
@@ -134,271 +169,167 @@ BType
 
 ConstDefs
   : ConstDef {
-    auto ast = new ConstDefsAST();
-    ast->const_defs.push_back(std::unique_ptr<BaseAST>($1));
+    auto ast = cc.arena.New<ConstDefsAST>(cc.arena);
+    ast->const_defs.push_back($1);
     $$ = ast;
   }
   | ConstDefs ',' ConstDef {
-    auto ast = new ConstDefsAST();
-    ast->const_defs = std::move(((ConstDefsAST*)$1)->const_defs);
-    ast->const_defs.push_back(std::unique_ptr<BaseAST>($3));
-    $$ = ast;
+    ((ConstDefsAST*)$1)->const_defs.push_back($3);
+    $$ = $1;
   }
   ;
 
 ConstDef
   : IDENT '=' ConstInitVal {
-    auto ast = new ConstDefAST();
-    ast->indent = *($1);
-    ast->const_init_val = std::unique_ptr<BaseAST>($3);
-    ast->saveSymbol();
+    auto ast = cc.arena.New<ConstDefAST>();
+    ast->indent = $1;
+    ast->name = cc.interner.Name($1);
+    ast->const_init_val = $3;
     $$ = ast;
   }
   ;
 
+// 表达式的各个语法层级只在 ExprPool 中创建真正有运算的节点
+// 只起传递作用的产生式 (例如 Exp: LOrExp) 直接把子节点的 ExprId 传上去
 ConstInitVal
   : ConstExp {
-    auto ast = new ConstInitValAST();
-    ast->const_exp = std::unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   ;
 
-
 ConstExp
   : Exp {
-    auto ast = new ConstExpAST();
-    ast->exp = std::unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   ;
 
 Stmt
   : RETURN Exp ';' {
-    auto ast = new StmtAST();
-    ast->exp = unique_ptr<BaseAST>($2);
+    auto ast = cc.arena.New<StmtAST>();
+    ast->exp = $2;
     $$ = ast;
   }
   ;
 
 Exp
   : LOrExp {
-      auto ast = new ExpAST();
-      ast->lor_exp = unique_ptr<BaseAST>($1);
-      $$ = ast;
+    $$ = $1;
   }
   ;
 
 LOrExp
   : LAndExp {
-      auto ast = new LOrExpAST();
-      ast->landexp = unique_ptr<BaseAST>($1);
-      ast->type = LOrExpAST::LOrExpType::LANDEXP;
-      $$ = ast;
+    $$ = $1;
   }
   | LOrExp OR LAndExp {
-      auto ast = new LOrExpAST();
-      ast->lorexp = unique_ptr<BaseAST>($1);
-      ast->landexp = unique_ptr<BaseAST>($3);
-      ast->type = LOrExpAST::LOrExpType::LOREXP_OR_LANDEXP;
-      $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::LOR, $1, $3);
   }
   ;
 
 LAndExp
   : EqExp {
-      auto ast = new LAndExpAST();
-      ast->eqexp = unique_ptr<BaseAST>($1);
-      ast->type = LAndExpAST::LAndExpType::EQEXP;
-      $$ = ast;
+    $$ = $1;
   }
   | LAndExp AND EqExp {
-      auto ast = new LAndExpAST();
-      ast->landexp = unique_ptr<BaseAST>($1);
-      ast->eqexp = unique_ptr<BaseAST>($3);
-      ast->type = LAndExpAST::LAndExpType::LANDEXP_AND_EQEXP;
-      $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::LAND, $1, $3);
   }
   ;
 
 EqExp
   : RelExp {
-    auto ast = new EqExpAST();
-    ast->relexp = unique_ptr<BaseAST>($1);
-    ast->type = EqExpAST::EqExpType::RELEXP;
-    $$ = ast;
+    $$ = $1;
   }
   | EqExp EQ RelExp {
-    auto ast = new EqExpAST();
-    ast->eqexp = unique_ptr<BaseAST>($1);
-    ast->relexp = unique_ptr<BaseAST>($3);
-    ast->type = EqExpAST::EqExpType::EQEXP_EQ_RELEXP;
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::EQ, $1, $3);
   }
   | EqExp NE RelExp {
-    auto ast = new EqExpAST();
-    ast->eqexp = unique_ptr<BaseAST>($1);
-    ast->relexp = unique_ptr<BaseAST>($3);
-    ast->type = EqExpAST::EqExpType::EQEXP_NE_RELEXP;
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::NE, $1, $3);
   }
   ;
 
 RelExp
   : AddExp {
-    auto ast = new RelExpAST();
-    ast->addexp = unique_ptr<BaseAST>($1);
-    ast->type = RelExpAST::RelExpType::ADDEXP;
-    $$ = ast;
+    $$ = $1;
   }
   | RelExp '<' AddExp {
-    auto ast = new RelExpAST();
-    ast->relexp = unique_ptr<BaseAST>($1);
-    ast->addexp = unique_ptr<BaseAST>($3);
-    ast->type = RelExpAST::RelExpType::RELEXP_LT_ADDEXP;
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::LT, $1, $3);
   }
   | RelExp '>' AddExp {
-    auto ast = new RelExpAST();
-    ast->relexp = unique_ptr<BaseAST>($1);
-    ast->addexp = unique_ptr<BaseAST>($3);
-    ast->type = RelExpAST::RelExpType::RELEXP_GT_ADDEXP;
-    $$ = ast;
-
+    $$ = cc.exprs.Binary(ExprOp::GT, $1, $3);
   }
   | RelExp LE AddExp {
-    auto ast = new RelExpAST();
-    ast->relexp = unique_ptr<BaseAST>($1);
-    ast->addexp = unique_ptr<BaseAST>($3);
-    ast->type = RelExpAST::RelExpType::RELEXP_LE_ADDEXP;
-    $$ = ast;
-
+    $$ = cc.exprs.Binary(ExprOp::LE, $1, $3);
   }
   | RelExp GE AddExp {
-    auto ast = new RelExpAST();
-    ast->relexp = unique_ptr<BaseAST>($1);
-    ast->addexp = unique_ptr<BaseAST>($3);
-    ast->type = RelExpAST::RelExpType::RELEXP_GE_ADDEXP;
-    $$ = ast;
-
+    $$ = cc.exprs.Binary(ExprOp::GE, $1, $3);
   }
   ;
 
 AddExp
   : MulExp {
-    auto ast = new AddExpAST();
-    ast->type = AddExpAST::AddExpType::MULEXP;
-    ast->mulexp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | AddExp '+' MulExp {
-    auto ast = new AddExpAST();
-    ast->type = AddExpAST::AddExpType::ADDEXP_ADD_MULEXP;
-    ast->addexp = unique_ptr<BaseAST>($1);
-    ast->mulexp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::ADD, $1, $3);
   }
   | AddExp '-' MulExp {
-    auto ast = new AddExpAST();
-    ast->type = AddExpAST::AddExpType::ADDEXP_MINUS_MULEXP;
-    ast->addexp = unique_ptr<BaseAST>($1);
-    ast->mulexp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::SUB, $1, $3);
   }
   ;
+
 MulExp
   : UnaryExp {
-    auto ast = new MulExpAST();
-    ast->type = MulExpAST::MultExpType::UNARYEXP;
-    ast->unaryexp = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | MulExp '*' UnaryExp {
-    auto ast = new MulExpAST();
-    ast->type = MulExpAST::MultExpType::MULEXP_MULT_UNARYEXP;
-    ast->mulexp = unique_ptr<BaseAST>($1);
-    ast->unaryexp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::MUL, $1, $3);
   }
   | MulExp '/' UnaryExp {
-    auto ast = new MulExpAST();
-    ast->type = MulExpAST::MultExpType::MULEXP_DIV_UNARYEXP;
-    ast->mulexp = unique_ptr<BaseAST>($1);
-    ast->unaryexp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::DIV, $1, $3);
   }
   | MulExp '%' UnaryExp {
-    auto ast = new MulExpAST();
-    ast->type = MulExpAST::MultExpType::MULEXP_MOD_UNARYEXP;
-    ast->mulexp = unique_ptr<BaseAST>($1);
-    ast->unaryexp = unique_ptr<BaseAST>($3);
-    $$ = ast;
+    $$ = cc.exprs.Binary(ExprOp::MOD, $1, $3);
   }
   ;
 
 UnaryExp
   : PrimaryExp {
-      auto ast = new UnaryExpAST();
-      ast->primary_exp = unique_ptr<BaseAST>($1);
-      ast->type = UnaryExpAST::UnaryExpType::PRIMARY_EXP;
-      $$ = ast;
+    $$ = $1;
   }
   | UnaryOp UnaryExp {
-      auto ast = new UnaryExpAST();
-      ast->type = UnaryExpAST::UnaryExpType::UNARYOP_UNARYEXP;
-      ast->unary_op = unique_ptr<BaseAST>($1);
-      ast->unary_exp = unique_ptr<BaseAST>($2);
-      $$ = ast;
+    // 一元 '+' 不产生节点
+    ExprOp op = (ExprOp)$1;
+    $$ = op == ExprOp::NONE ? $2 : cc.exprs.Unary(op, $2);
   }
   ;
 
 PrimaryExp
-  : '('Exp')' {
-    auto ast = new PrimaryExpAST();
-    ast->type = PrimaryExpAST::PrimaryExpType::EXP;
-    ast->exp = unique_ptr<BaseAST>($2);
-    $$ = ast;
+  : '(' Exp ')' {
+    $$ = $2;
   }
   | LVal {
-    auto ast = new PrimaryExpAST();
-    ast->type = PrimaryExpAST::PrimaryExpType::LVAL;
-    ast->lval = unique_ptr<BaseAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | Number {
-    auto ast = new PrimaryExpAST();
-    ast->type = PrimaryExpAST::PrimaryExpType::NUMBER;
-    ast->number = $1;
-    $$ = ast;
+    $$ = cc.exprs.Number($1);
   }
   ;
 
 LVal
   : IDENT {
-    auto ast = new LValAST();
-    ast->ident = *($1);
-    $$ = ast;
+    $$ = cc.exprs.LVal($1);
   }
   ;
 
 UnaryOp
   : '+' {
-    // std::cout << "+: " << *(yylval.str_val) << std::endl;
-    auto ast = new UnaryOpAST();
-    ast->type = UnaryOpAST::UnaryOpType::ADD;
-    $$ = ast;
+    $$ = (int)ExprOp::NONE;
   }
   | '-' {
-    // std::cout << "-: " << *(yylval.str_val) << std::endl;
-    auto ast = new UnaryOpAST();
-    ast->type = UnaryOpAST::UnaryOpType::MINUS;
-    $$ = ast;
+    $$ = (int)ExprOp::NEG;
   }
   | '!' {
-    // std::cout << "!: " << *(yylval.str_val) << std::endl;
-    auto ast = new UnaryOpAST();
-    ast->type = UnaryOpAST::UnaryOpType::NEGATION;
-    $$ = ast;
+    $$ = (int)ExprOp::NOT;
   }
   ;
 
@@ -410,8 +341,11 @@ Number
 
 %%
 
-// 定义错误处理函数, 其中第二个参数是错误信息
+// 定义错误处理函数, 其中第一个参数是出错的 token 的位置, 最后一个参数是错误信息
 // parser 如果发生错误 (例如输入的程序出现了语法错误), 就会调用这个函数
-void yyerror(std::unique_ptr<BaseAST> &ast, const char *s) {
-  cerr << "error: " << s << endl;
+// 错误信息记在 cc.error 中, 由调用者报告 (单文件和 -batch 模式写到 stderr, -serve 模式随响应返回)
+void yyerror(SourceSpan *loc, yyscan_t scanner, CompileContext &cc, const char *s) {
+  if (!cc.error.empty()) return;
+  cc.error = string(cc.filename) + ":" + SourceLocation(cc.source, cc.source_size, loc->offset) +
+             ": error: " + s;
 }
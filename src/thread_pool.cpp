@@ -0,0 +1,87 @@
+#include <algorithm>
+#include "thread_pool.hpp"
+
+ThreadPool::ThreadPool(size_t threads) {
+  if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+  for (size_t i = 0; i < threads; i ++) {
+    queues_.emplace_back(new WorkQueue);
+  }
+  for (size_t i = 0; i < threads; i ++) {
+    workers_.emplace_back(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  Wait();
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  for (auto &worker : workers_) worker.join();
+}
+
+void ThreadPool::Submit(Task task) {
+  size_t index = next_queue_.fetch_add(1, std::memory_order_relaxed) % queues_.size();
+  pending_.fetch_add(1);
+  {
+    std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+    queues_[index]->tasks.push_back(std::move(task));
+  }
+  // 持有 sleep_mutex_ 再通知, 避免工作线程检查完队列, 还没开始等待时错过通知
+  std::lock_guard<std::mutex> lock(sleep_mutex_);
+  wake_.notify_one();
+}
+
+void ThreadPool::Wait() {
+  std::unique_lock<std::mutex> lock(sleep_mutex_);
+  done_.wait(lock, [this] { return pending_.load() == 0; });
+}
+
+bool ThreadPool::HasQueuedTask() {
+  for (auto &queue : queues_) {
+    std::lock_guard<std::mutex> lock(queue->mutex);
+    if (!queue->tasks.empty()) return true;
+  }
+  return false;
+}
+
+bool ThreadPool::PopLocal(size_t index, Task &task) {
+  WorkQueue &queue = *queues_[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.tasks.empty()) return false;
+  task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool ThreadPool::Steal(size_t thief, Task &task) {
+  for (size_t i = 1; i < queues_.size(); i ++) {
+    WorkQueue &queue = *queues_[(thief + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) continue;
+    task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::WorkerLoop(size_t index) {
+  for (;;) {
+    Task task;
+    if (PopLocal(index, task) || Steal(index, task)) {
+      task();
+      if (pending_.fetch_sub(1) == 1) {
+        std::lock_guard<std::mutex> lock(sleep_mutex_);
+        done_.notify_all();
+      }
+      continue;
+    }
+    // 所有队列都空了: 睡眠等待新任务
+    // 在 sleep_mutex_ 下重新检查队列, Submit 在放入任务后也要拿到 sleep_mutex_ 才能通知, 不会丢失唤醒
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [this] { return stopping_ || HasQueuedTask(); });
+    if (stopping_ && !HasQueuedTask()) return;
+  }
+}
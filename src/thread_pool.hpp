@@ -0,0 +1,57 @@
+#ifndef __THREAD_POOL_HPP__
+#define __THREAD_POOL_HPP__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// work-stealing 线程池
+// 每个工作线程有自己的任务队列, 从队尾取自己的任务; 自己的队列空了就从其他线程的队首偷任务
+// 这样大任务和小任务混在一起时, 先做完的线程会去帮忙, 不会有线程空等
+class ThreadPool {
+ public:
+  using Task = std::function<void()>;
+
+  // threads 为 0 时使用硬件线程数
+  explicit ThreadPool(size_t threads);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  // 等待所有任务完成后退出
+  ~ThreadPool();
+
+  // 按轮转的方式把任务放进各个线程的队列
+  void Submit(Task task);
+  // 阻塞直到已提交的任务全部完成
+  void Wait();
+  size_t Size() const { return workers_.size(); }
+
+ private:
+  struct WorkQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void WorkerLoop(size_t index);
+  bool HasQueuedTask();
+  bool PopLocal(size_t index, Task &task);
+  bool Steal(size_t thief, Task &task);
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> next_queue_{0};
+  // 已提交但还没有执行完的任务数
+  std::atomic<size_t> pending_{0};
+  std::atomic<bool> stopping_{false};
+  // 没有任务时工作线程在 wake_ 上等待, Wait() 在 done_ 上等待
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  std::condition_variable done_;
+};
+
+#endif
@@ -0,0 +1,50 @@
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "trace.hpp"
+
+int g_trace_levels[(int)TraceCategory::COUNT];
+
+static const char *kCategoryNames[] = {
+  "lexer",
+  "parser",
+  "irgen",
+  "opt",
+  "isel",
+  "regalloc",
+  "peephole",
+  "sched",
+  "cache"
+};
+
+const char* TraceCategoryName(TraceCategory category) {
+  return kCategoryNames[(int)category];
+}
+
+bool ParseTraceOption(const char *spec) {
+  std::string items(spec);
+  size_t pos = 0;
+  while (pos <= items.size()) {
+    size_t end = items.find(',', pos);
+    if (end == std::string::npos) end = items.size();
+    std::string item = items.substr(pos, end - pos);
+    pos = end + 1;
+    if (item.empty()) continue;
+
+    int level = 1;
+    size_t colon = item.find(':');
+    if (colon != std::string::npos) {
+      level = atoi(item.c_str() + colon + 1);
+      item = item.substr(0, colon);
+    }
+    bool found = false;
+    for (int i = 0; i < (int)TraceCategory::COUNT; i ++) {
+      if (item == "all" || item == kCategoryNames[i]) {
+        g_trace_levels[i] = level;
+        found = true;
+      }
+    }
+    if (!found) return false;
+  }
+  return true;
+}
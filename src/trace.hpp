@@ -0,0 +1,50 @@
+#ifndef __TRACE_HPP__
+#define __TRACE_HPP__
+
+#include <iostream>
+
+// 分类/分级的调试输出
+// 运行时用 -trace=irgen:2,isel 这样的选项打开, 级别越高输出越详细
+// 编译时没有定义 ENABLE_TRACE (DEBUG=0) 时, TRACE 展开为空语句, 参数也不会被求值
+#ifndef ENABLE_TRACE
+#define ENABLE_TRACE 0
+#endif
+
+enum class TraceCategory {
+  LEXER,
+  PARSER,
+  IRGEN,
+  OPT,
+  ISEL,
+  REGALLOC,
+  PEEPHOLE,
+  SCHED,
+  CACHE,
+  COUNT
+};
+
+extern int g_trace_levels[(int)TraceCategory::COUNT];
+
+inline bool TraceEnabled(TraceCategory category, int level) {
+  return g_trace_levels[(int)category] >= level;
+}
+
+const char* TraceCategoryName(TraceCategory category);
+
+// 解析 "lexer,irgen:2" 形式的配置, 不写级别时为 1, "all" 表示所有类别
+// 配置有误时返回 false
+bool ParseTraceOption(const char *spec);
+
+#if ENABLE_TRACE
+#define TRACE(category, level, message)                                     \
+  do {                                                                      \
+    if (TraceEnabled(TraceCategory::category, level)) {                     \
+      std::cerr << "[" << TraceCategoryName(TraceCategory::category) << "] " \
+                << message << std::endl;                                    \
+    }                                                                       \
+  } while (0)
+#else
+#define TRACE(category, level, message) do {} while (0)
+#endif
+
+#endif
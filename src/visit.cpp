@@ -1,59 +1,368 @@
-#include <string>
-#include <iostream>
 #include <cassert>
-#include <vector>
-#include <unordered_map>
+#include <cstdint>
+#include <string>
+#include "mir.hpp"
+#include "encoder.hpp"
+#include "peephole.hpp"
+#include "schedule.hpp"
+#include "regalloc.hpp"
+#include "riscv.hpp"
+#include "trace.hpp"
 #include "visit.hpp"
 
-std::unordered_map<const koopa_raw_binary_t*, int> reg_id_map;
-std::vector<int> g_used_ids(7, 0);
 
-int getRegIdx(const koopa_raw_binary_t& binary) {
-  const koopa_raw_binary_t* bp = &binary;
-  if (reg_id_map.count(bp)) {
-    return reg_id_map[bp];
+static void load_imm(int reg, int32_t value, RiscvContext &ctx) {
+  EmitLoadImm(ctx.mf.insts, reg, value);
+}
+
+static void stack_load(int reg, int offset, int tmp, RiscvContext &ctx) {
+  EmitStackLoad(ctx.mf.insts, reg, offset, tmp);
+}
+
+static void stack_store(int reg, int offset, int tmp, RiscvContext &ctx) {
+  EmitStackStore(ctx.mf.insts, reg, offset, tmp);
+}
+
+// sp += delta, 只在寄存器分配之后生成 prologue/epilogue 时使用, t0 此时可以随意使用
+static void adjust_sp(int delta, RiscvContext &ctx) {
+  if (FitsImm12(delta)) {
+    ctx.Emit(MachineInst::I(MachineOp::ADDI, RV_SP, RV_SP, delta));
+  } else {
+    load_imm(RV_T0, delta, ctx);
+    ctx.Emit(MachineInst::R(MachineOp::ADD, RV_SP, RV_SP, RV_T0));
+  }
+}
+
+// 指令结果所在的虚拟寄存器, 第一次用到 (定义或者使用) 时分配
+static int value_reg(const koopa_raw_value_t &value, RiscvContext &ctx) {
+  auto it = ctx.value_regs.find(value);
+  if (it != ctx.value_regs.end()) return it->second;
+  int reg = ctx.mf.NewVirtualReg();
+  ctx.value_regs[value] = reg;
+  return reg;
+}
+
+// 把操作数放进寄存器并返回寄存器编号
+// 常量 0 直接使用 zero 寄存器, 其他常量每次使用时重新加载到一个新的虚拟寄存器中
+static int load_operand(const koopa_raw_value_t &value, RiscvContext &ctx) {
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    int32_t imm = value->kind.data.integer.value;
+    if (imm == 0) return RV_ZERO;
+    int reg = ctx.mf.NewVirtualReg();
+    load_imm(reg, imm, ctx);
+    return reg;
+  }
+  return value_reg(value, ctx);
+}
+
+// 二元运算的指令选择表, 在编译期由 MakeBinaryPatterns 按 KOOPA_RBO_* 建好
+// 每种运算有寄存器-寄存器形式, 以及右操作数是 12 位立即数时的 I 型形式 (没有时 ri_op 为 nullptr)
+// 两种形式之后都可能跟一条对结果取布尔值的指令
+enum class PostOp { NONE, SEQZ, SNEZ };
+
+// 立即数形式使用的立即数: 原值, 相反数 (sub => addi) 或者加一 (x <= c => x < c + 1)
+enum class ImmKind { SAME, NEGATE, PLUS_ONE, SHAMT };
+
+constexpr int kNoPattern = -1;
+constexpr int kBinaryOpCount = KOOPA_RBO_SAR + 1;
+
+struct BinaryPattern {
+  MachineOp rr_op;
+  PostOp rr_post;
+  // 没有立即数形式时为 MachineOp::COUNT
+  MachineOp ri_op;
+  ImmKind imm_kind;
+  PostOp ri_post;
+  // 立即数为 0 时结果就是另一个操作数 (再做 ri_post)
+  bool zero_identity;
+  // 交换两个操作数后等价的运算, 左操作数是常量时用它的立即数形式
+  int swapped;
+};
+
+constexpr BinaryPattern PatternFor(koopa_raw_binary_op_t op) {
+  switch (op) {
+    case KOOPA_RBO_ADD:
+      return {MachineOp::ADD, PostOp::NONE, MachineOp::ADDI, ImmKind::SAME, PostOp::NONE, true, KOOPA_RBO_ADD};
+    case KOOPA_RBO_SUB:
+      return {MachineOp::SUB, PostOp::NONE, MachineOp::ADDI, ImmKind::NEGATE, PostOp::NONE, true, kNoPattern};
+    case KOOPA_RBO_MUL:
+      return {MachineOp::MUL, PostOp::NONE, MachineOp::COUNT, ImmKind::SAME, PostOp::NONE, false, kNoPattern};
+    case KOOPA_RBO_DIV:
+      return {MachineOp::DIV, PostOp::NONE, MachineOp::COUNT, ImmKind::SAME, PostOp::NONE, false, kNoPattern};
+    case KOOPA_RBO_MOD:
+      return {MachineOp::REM, PostOp::NONE, MachineOp::COUNT, ImmKind::SAME, PostOp::NONE, false, kNoPattern};
+    case KOOPA_RBO_AND:
+      return {MachineOp::AND, PostOp::NONE, MachineOp::ANDI, ImmKind::SAME, PostOp::NONE, false, KOOPA_RBO_AND};
+    case KOOPA_RBO_OR:
+      return {MachineOp::OR, PostOp::NONE, MachineOp::ORI, ImmKind::SAME, PostOp::NONE, true, KOOPA_RBO_OR};
+    case KOOPA_RBO_XOR:
+      return {MachineOp::XOR, PostOp::NONE, MachineOp::XORI, ImmKind::SAME, PostOp::NONE, true, KOOPA_RBO_XOR};
+    case KOOPA_RBO_SHL:
+      return {MachineOp::SLL, PostOp::NONE, MachineOp::SLLI, ImmKind::SHAMT, PostOp::NONE, true, kNoPattern};
+    case KOOPA_RBO_SHR:
+      return {MachineOp::SRL, PostOp::NONE, MachineOp::SRLI, ImmKind::SHAMT, PostOp::NONE, true, kNoPattern};
+    case KOOPA_RBO_SAR:
+      return {MachineOp::SRA, PostOp::NONE, MachineOp::SRAI, ImmKind::SHAMT, PostOp::NONE, true, kNoPattern};
+    // x == y  =>  seqz (x ^ y)
+    case KOOPA_RBO_EQ:
+      return {MachineOp::XOR, PostOp::SEQZ, MachineOp::XORI, ImmKind::SAME, PostOp::SEQZ, true, KOOPA_RBO_EQ};
+    case KOOPA_RBO_NOT_EQ:
+      return {MachineOp::XOR, PostOp::SNEZ, MachineOp::XORI, ImmKind::SAME, PostOp::SNEZ, true, KOOPA_RBO_NOT_EQ};
+    case KOOPA_RBO_LT:
+      return {MachineOp::SLT, PostOp::NONE, MachineOp::SLTI, ImmKind::SAME, PostOp::NONE, false, KOOPA_RBO_GT};
+    // x > c  =>  !(x < c + 1)
+    case KOOPA_RBO_GT:
+      return {MachineOp::SGT, PostOp::NONE, MachineOp::SLTI, ImmKind::PLUS_ONE, PostOp::SEQZ, false, KOOPA_RBO_LT};
+    // x <= y  =>  !(x > y), x <= c  =>  x < c + 1
+    case KOOPA_RBO_LE:
+      return {MachineOp::SGT, PostOp::SEQZ, MachineOp::SLTI, ImmKind::PLUS_ONE, PostOp::NONE, false, KOOPA_RBO_GE};
+    // x >= y  =>  !(x < y)
+    case KOOPA_RBO_GE:
+      return {MachineOp::SLT, PostOp::SEQZ, MachineOp::SLTI, ImmKind::SAME, PostOp::SEQZ, false, KOOPA_RBO_LE};
+  }
+  return {MachineOp::COUNT, PostOp::NONE, MachineOp::COUNT, ImmKind::SAME, PostOp::NONE, false, kNoPattern};
+}
+
+struct BinaryPatternTable {
+  BinaryPattern patterns[kBinaryOpCount];
+  constexpr const BinaryPattern& operator[](int op) const { return patterns[op]; }
+};
+
+constexpr BinaryPatternTable MakeBinaryPatterns() {
+  BinaryPatternTable table = {};
+  for (int op = 0; op < kBinaryOpCount; op ++) {
+    table.patterns[op] = PatternFor(static_cast<koopa_raw_binary_op_t>(op));
   }
-  return -1;
+  return table;
 }
-void setRegIdx(const koopa_raw_binary_t& binary, int idx) {
-  const koopa_raw_binary_t* bp = &binary;
-  reg_id_map[bp] = idx;
-  g_used_ids[idx] = 1;
+
+constexpr BinaryPatternTable kBinaryPatterns = MakeBinaryPatterns();
+static_assert(kBinaryPatterns[KOOPA_RBO_SUB].imm_kind == ImmKind::NEGATE, "sub uses addi -imm");
+static_assert(kBinaryPatterns[kBinaryPatterns[KOOPA_RBO_LT].swapped].rr_op == MachineOp::SGT,
+              "lt swaps to gt");
+
+// 计算立即数形式的立即数, 没有立即数形式或者放不进 12 位时返回 false
+static bool ImmediateFor(const BinaryPattern &pattern, int32_t value, int32_t &imm) {
+  if (pattern.ri_op == MachineOp::COUNT) return false;
+  switch (pattern.imm_kind) {
+    case ImmKind::SAME:
+      imm = value;
+      break;
+    case ImmKind::NEGATE:
+      if (value == INT32_MIN) return false;
+      imm = -value;
+      break;
+    case ImmKind::PLUS_ONE:
+      if (value == INT32_MAX) return false;
+      imm = value + 1;
+      break;
+    case ImmKind::SHAMT:
+      // RV32 的移位量只有 5 位
+      if (value < 0 || value > 31) return false;
+      imm = value;
+      return true;
+  }
+  return FitsImm12(imm);
+}
+
+// 对 src 的值取布尔值, 结果放进 dst; 没有后缀指令时 dst 与 src 相同, 什么都不做
+static void post_op(PostOp post, int dst, int src, RiscvContext &ctx) {
+  switch (post) {
+    case PostOp::NONE:
+      break;
+    case PostOp::SEQZ:
+      ctx.Emit(MachineInst::Unary(MachineOp::SEQZ, dst, src));
+      break;
+    case PostOp::SNEZ:
+      ctx.Emit(MachineInst::Unary(MachineOp::SNEZ, dst, src));
+      break;
+  }
+}
+
+// 乘除常量的强度削减: mul/div/rem 需要很多个周期, 常量操作数换成移位/加减或者乘高位
+// v 是 2 的幂时返回它的指数, 否则返回 -1
+static int log2_exact(uint32_t v) {
+  return v && !(v & (v - 1)) ? __builtin_ctz(v) : -1;
+}
+
+// 有符号除以常量 d (|d| >= 3, 不是 2 的幂) 所用的魔数, 见 Hacker's Delight 10-1:
+// q = (mulh(x, magic) [+/- x]) >> shift, 再对负数结果加一
+struct DivMagic {
+  int32_t magic;
+  int shift;
+};
+
+static DivMagic signed_div_magic(int32_t d) {
+  const uint32_t two31 = 0x80000000u;
+  uint32_t ad = d < 0 ? -(uint32_t)d : d;
+  uint32_t t = two31 + ((uint32_t)d >> 31);
+  uint32_t anc = t - 1 - t % ad;
+  int p = 31;
+  uint32_t q1 = two31 / anc, r1 = two31 - q1 * anc;
+  uint32_t q2 = two31 / ad, r2 = two31 - q2 * ad;
+  uint32_t delta;
+  do {
+    p ++;
+    q1 = 2 * q1;
+    r1 = 2 * r1;
+    if (r1 >= anc) {
+      q1 ++;
+      r1 -= anc;
+    }
+    q2 = 2 * q2;
+    r2 = 2 * r2;
+    if (r2 >= ad) {
+      q2 ++;
+      r2 -= ad;
+    }
+    delta = ad - r2;
+  } while (q1 < delta || (q1 == delta && r1 == 0));
+  uint32_t magic = q2 + 1;
+  return {(int32_t)(d < 0 ? -magic : magic), p - 32};
+}
+
+// x * c: 0, ±1, ±2^k, 2^k + 1 以及 2^k - 1 不用 mul
+static bool reduce_mul(int dst, const koopa_raw_value_t &operand, int32_t c, RiscvContext &ctx) {
+  uint32_t mag = c < 0 ? -(uint32_t)c : c;
+  int k = log2_exact(mag), plus_one = log2_exact((uint32_t)c - 1), minus_one = log2_exact((uint32_t)c + 1);
+  if (c == 0) {
+    load_imm(dst, 0, ctx);
+    return true;
+  }
+  if (k < 0 && (c < 0 || (plus_one < 0 && minus_one < 0))) return false;
+  TRACE(ISEL, 3, "strength reduction: mul by " << c);
+  int src = load_operand(operand, ctx);
+  if (k >= 0) {
+    if (k > 0) {
+      ctx.Emit(MachineInst::I(MachineOp::SLLI, dst, src, k));
+      src = dst;
+    }
+    if (c < 0) {
+      ctx.Emit(MachineInst::R(MachineOp::SUB, dst, RV_ZERO, src));
+    } else if (dst != src) {
+      ctx.Emit(MachineInst::Unary(MachineOp::MV, dst, src));
+    }
+  } else {
+    // x * (2^k + 1) = (x << k) + x, x * (2^k - 1) = (x << k) - x
+    int shifted = ctx.mf.NewVirtualReg();
+    ctx.Emit(MachineInst::I(MachineOp::SLLI, shifted, src, plus_one >= 0 ? plus_one : minus_one));
+    ctx.Emit(MachineInst::R(plus_one >= 0 ? MachineOp::ADD : MachineOp::SUB, dst, shifted, src));
+  }
+  return true;
 }
 
-int makeOneRegId(std::vector<int>& used_ids) {
-  for (int i = 0; i < 7; i ++) {
-    if (!used_ids[i] && !g_used_ids[i]) {
-      used_ids[i] = 1;
-      return i;
+// x / d 和 x % d (向零取整, 对负数同样正确). d 为 0 时保留 div/rem, 它们的结果由硬件定义
+static bool reduce_div(int dst, const koopa_raw_value_t &operand, int32_t d, bool rem,
+                       RiscvContext &ctx) {
+  if (d == 0) return false;
+  TRACE(ISEL, 3, "strength reduction: " << (rem ? "rem" : "div") << " by " << d);
+  uint32_t mag = d < 0 ? -(uint32_t)d : d;
+  int k = log2_exact(mag);
+  if (mag == 1) {
+    // x % ±1 = 0, x / 1 = x, x / -1 = -x (INT32_MIN / -1 与 div 一样回绕成 INT32_MIN)
+    if (rem) {
+      load_imm(dst, 0, ctx);
+      return true;
+    }
+    int src = load_operand(operand, ctx);
+    if (d < 0) {
+      ctx.Emit(MachineInst::R(MachineOp::SUB, dst, RV_ZERO, src));
+    } else if (dst != src) {
+      ctx.Emit(MachineInst::Unary(MachineOp::MV, dst, src));
+    }
+    return true;
+  }
+
+  int src = load_operand(operand, ctx);
+  int q = ctx.mf.NewVirtualReg();
+  if (k > 0) {
+    // 算术右移向负无穷取整, x 为负时先加上 2^k - 1 使结果向零取整
+    if (k == 1) {
+      ctx.Emit(MachineInst::I(MachineOp::SRLI, q, src, 31));
+    } else {
+      ctx.Emit(MachineInst::I(MachineOp::SRAI, q, src, 31));
+      ctx.Emit(MachineInst::I(MachineOp::SRLI, q, q, 32 - k));
+    }
+    ctx.Emit(MachineInst::R(MachineOp::ADD, q, q, src));
+    if (rem) {
+      // x % ±2^k = x - ((x + bias) & -2^k), k 可以是 31 (d 为 INT32_MIN), 掩码按无符号数计算
+      int32_t mask = (int32_t)(~0u << k);
+      if (FitsImm12(mask)) {
+        ctx.Emit(MachineInst::I(MachineOp::ANDI, q, q, mask));
+      } else {
+        ctx.Emit(MachineInst::I(MachineOp::SRAI, q, q, k));
+        ctx.Emit(MachineInst::I(MachineOp::SLLI, q, q, k));
+      }
+      ctx.Emit(MachineInst::R(MachineOp::SUB, dst, src, q));
+    } else {
+      ctx.Emit(MachineInst::I(MachineOp::SRAI, dst, q, k));
+      if (d < 0) ctx.Emit(MachineInst::R(MachineOp::SUB, dst, RV_ZERO, dst));
     }
+    return true;
   }
-  return -1;
+
+  DivMagic m = signed_div_magic(d);
+  load_imm(q, m.magic, ctx);
+  ctx.Emit(MachineInst::R(MachineOp::MULH, q, src, q));
+  if (d > 0 && m.magic < 0) ctx.Emit(MachineInst::R(MachineOp::ADD, q, q, src));
+  if (d < 0 && m.magic > 0) ctx.Emit(MachineInst::R(MachineOp::SUB, q, q, src));
+  if (m.shift) ctx.Emit(MachineInst::I(MachineOp::SRAI, q, q, m.shift));
+  int sign = ctx.mf.NewVirtualReg();
+  ctx.Emit(MachineInst::I(MachineOp::SRLI, sign, q, 31));
+  if (!rem) {
+    ctx.Emit(MachineInst::R(MachineOp::ADD, dst, q, sign));
+    return true;
+  }
+  // x % d = x - q * d
+  ctx.Emit(MachineInst::R(MachineOp::ADD, q, q, sign));
+  int divisor = ctx.mf.NewVirtualReg();
+  load_imm(divisor, d, ctx);
+  ctx.Emit(MachineInst::R(MachineOp::MUL, q, q, divisor));
+  ctx.Emit(MachineInst::R(MachineOp::SUB, dst, src, q));
+  return true;
 }
-std::string makeRegString(int id) {
-  return "t" + std::to_string(id);
+
+// 乘除的某个操作数是常量时尝试强度削减, 成功时结果已经放进 dst
+static bool reduce_by_constant(const koopa_raw_binary_t &binary, int dst, RiscvContext &ctx) {
+  auto constant = [](const koopa_raw_value_t &v) { return v->kind.tag == KOOPA_RVT_INTEGER; };
+  switch (binary.op) {
+    case KOOPA_RBO_MUL:
+      if (constant(binary.rhs)) {
+        return reduce_mul(dst, binary.lhs, binary.rhs->kind.data.integer.value, ctx);
+      }
+      if (constant(binary.lhs)) {
+        return reduce_mul(dst, binary.rhs, binary.lhs->kind.data.integer.value, ctx);
+      }
+      return false;
+    case KOOPA_RBO_DIV:
+    case KOOPA_RBO_MOD:
+      if (!constant(binary.rhs)) return false;
+      return reduce_div(dst, binary.lhs, binary.rhs->kind.data.integer.value,
+                        binary.op == KOOPA_RBO_MOD, ctx);
+    default:
+      return false;
+  }
 }
 
 // 访问 raw program
-std::string Visit(const koopa_raw_program_t &program) {
-  std::string ret;
-  ret += "\t.text\n";
+// 所有状态都放在这次调用自己的 RiscvContext 里, 不同线程可以同时为不同的程序生成代码
+CodegenStats Visit(const koopa_raw_program_t &program, OutputSink &out,
+                   const CodegenOptions &options) {
+  RiscvContext ctx(out, options);
+  if (!options.emit_object) ctx.out << "\t.text\n";
   
   // 执行一些其他的必要操作
   // ...
   // 访问所有全局变量
-  std::cout << "------------2-------------" << std::endl;
-  ret += Visit(program.values);
-  std::cout << "-------------3------------" << std::endl;
+  Visit(program.values, ctx);
   // 访问所有函数
-  ret += Visit(program.funcs);
-  std::cout << "-------------4------------" << std::endl;
-  return ret;
+  Visit(program.funcs, ctx);
+  if (options.emit_object) ctx.object.Write(ctx.out);
+  return ctx.stats;
 }
 
 // 访问 raw slice
-std::string Visit(const koopa_raw_slice_t &slice) {
-  std::string ret;
+void Visit(const koopa_raw_slice_t &slice, RiscvContext &ctx) {
   for (size_t i = 0; i < slice.len; ++i) {
     auto ptr = slice.buffer[i];
     
@@ -61,221 +370,235 @@ std::string Visit(const koopa_raw_slice_t &slice) {
     switch (slice.kind) {
       case KOOPA_RSIK_FUNCTION:
         // 访问函数
-        std::cout << "KOOPA_RSIK_FUNCTION" << std::endl;
-        ret += Visit(reinterpret_cast<koopa_raw_function_t>(ptr));
+        Visit(reinterpret_cast<koopa_raw_function_t>(ptr), ctx);
         break;
       case KOOPA_RSIK_BASIC_BLOCK:
         // 访问基本块
-        std::cout << "KOOPA_RSIK_BASIC_BLOCK" << std::endl;
-        ret += Visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr));
+        Visit(reinterpret_cast<koopa_raw_basic_block_t>(ptr), ctx);
         break;
       case KOOPA_RSIK_VALUE:
         // 访问指令
-        std::cout << "KOOPA_RSIK_VALUE" << std::endl;
-        ret += Visit(reinterpret_cast<koopa_raw_value_t>(ptr));
+        Visit(reinterpret_cast<koopa_raw_value_t>(ptr), ctx);
         break;
       default:
         // 我们暂时不会遇到其他内容, 于是不对其做任何处理
         assert(false);
     }
   }
-  return ret;
+}
+
+// 每个 alloc 在栈帧开头占一个栈槽, load/store 直接访问它
+static void assign_alloc_slots(const koopa_raw_function_t &func, RiscvContext &ctx) {
+  ctx.alloc_offsets.clear();
+  for (size_t i = 0; i < func->bbs.len; i ++) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (size_t j = 0; j < bb->insts.len; j ++) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      if (inst->kind.tag != KOOPA_RVT_ALLOC) continue;
+      ctx.alloc_offsets[inst] = ctx.mf.frame_bytes;
+      TRACE(ISEL, 2, "alloc at " << ctx.mf.frame_bytes << "(sp)");
+      ctx.mf.frame_bytes += 4;
+    }
+  }
+}
+
+// 寄存器分配之后栈帧的大小才确定: 在函数开头插入 prologue (分配栈帧, 保存用到的 s 寄存器),
+// 在每个 ret 之前插入 epilogue (恢复 s 寄存器, 释放栈帧)
+static void lower_frame(const RegisterAllocation &alloc, RiscvContext &ctx) {
+  std::vector<MachineInst> body;
+  body.swap(ctx.mf.insts);
+  if (alloc.frame_size) adjust_sp(-alloc.frame_size, ctx);
+  for (size_t i = 0; i < alloc.saved_regs.size(); i ++) {
+    stack_store(alloc.saved_regs[i], alloc.saved_offsets[i], RV_T0, ctx);
+  }
+  for (const auto &inst : body) {
+    if (inst.op == MachineOp::RET) {
+      for (size_t i = 0; i < alloc.saved_regs.size(); i ++) {
+        stack_load(alloc.saved_regs[i], alloc.saved_offsets[i], RV_T0, ctx);
+      }
+      if (alloc.frame_size) adjust_sp(alloc.frame_size, ctx);
+    }
+    ctx.Emit(inst);
+  }
 }
 
 // 访问函数
-std::string Visit(const koopa_raw_function_t &func) {
-  std::string ret;
-  // 执行一些其他的必要操作
-  // ...
-  // 访问所有基本块
-  ret += "\t.globl ";
-  std::string main = func->name;
-  main = main.substr(1);
-  ret += main;
-  ret += "\n";
-  ret += main;
-  ret +=  ":\n";
-  ret += Visit(func->bbs);
-  return ret;
+void Visit(const koopa_raw_function_t &func, RiscvContext &ctx) {
+  // 函数名去掉开头的 '@'
+  const char *name = func->name + 1;
+  TRACE(ISEL, 1, "function " << name);
+  ctx.entry_bb = func->bbs.len ? reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[0]) : nullptr;
+  ctx.mf.name = name;
+  ctx.mf.insts.clear();
+  ctx.mf.next_vreg = kFirstVirtualReg;
+  ctx.mf.frame_bytes = 0;
+  ctx.value_regs.clear();
+  assign_alloc_slots(func, ctx);
+  // 访问所有基本块, 生成使用虚拟寄存器的机器指令
+  Visit(func->bbs, ctx);
+  RegisterAllocation alloc = AllocateRegisters(ctx.mf);
+  lower_frame(alloc, ctx);
+  if (ctx.options.peephole_window > 0) {
+    ctx.stats.peephole_removed += RunPeephole(ctx.mf, ctx.options.peephole_window);
+  }
+  // 调度放在最后, 窥孔优化依赖的相邻指令模式这时已经处理完了
+  if (ctx.options.sched_model) {
+    ScheduleStats sched = ScheduleInstructions(ctx.mf, *ctx.options.sched_model);
+    ctx.stats.sched.cycles_before += sched.cycles_before;
+    ctx.stats.sched.cycles_after += sched.cycles_after;
+  }
+  if (ctx.options.emit_object) {
+    std::vector<uint8_t> &text = ctx.object.Text();
+    size_t offset = text.size();
+    EncodeMachineFunction(ctx.mf, text);
+    ctx.object.AddFunction(name, offset, text.size() - offset);
+  } else {
+    PrintMachineFunction(ctx.mf, ctx.out);
+  }
 }
 
 // 访问基本块
-std::string Visit(const koopa_raw_basic_block_t &bb) {
+void Visit(const koopa_raw_basic_block_t &bb, RiscvContext &ctx) {
   // 执行一些其他的必要操作
   // ...
   // 访问所有指令
   
-  std::cout << "koopa_raw_basic_block_t: " << bb->name << std::endl;
-  return Visit(bb->insts);
+  TRACE(ISEL, 1, "basic block " << bb->name);
+  // 入口块紧跟在函数标号和 prologue 之后, 不需要单独的标号
+  if (bb != ctx.entry_bb) ctx.Emit(MachineInst::Label(bb));
+  Visit(bb->insts, ctx);
 }
 
 
-std::string Visit(const koopa_raw_return_t &ret) {
-  std::string retxx;
-  std::cout << "Visit koopa_raw_return_t" << std::endl;
-  if (ret.value->name == nullptr) std::cout << "name null." << std::endl;
-  std::cout << "tag: " << ret.value->ty->tag << std::endl;
-  retxx += ret.value->kind.tag == KOOPA_RVT_INTEGER ? "\tli a0, " : "\tmv a0, ";
-  retxx += ret.value->kind.tag == KOOPA_RVT_INTEGER ? std::to_string(ret.value->kind.data.integer.value) : "t" + std::to_string(getRegIdx(ret.value->kind.data.binary));
-  retxx += "\n";
-  retxx += "\tret";
-  return retxx;
+void Visit(const koopa_raw_return_t &ret, RiscvContext &ctx) {
+  if (ret.value) {
+    TRACE(ISEL, 2, "ret, value tag: " << ret.value->kind.tag);
+    if (ret.value->kind.tag == KOOPA_RVT_INTEGER) {
+      load_imm(RV_A0, ret.value->kind.data.integer.value, ctx);
+    } else {
+      ctx.Emit(MachineInst::Unary(MachineOp::MV, RV_A0, value_reg(ret.value, ctx)));
+    }
+  }
+  // epilogue 由 lower_frame 在寄存器分配之后插入
+  ctx.Emit(MachineInst::Ret());
 }
 
-std::string Visit(const koopa_raw_integer_t &integer) {
-  std::cout << "Visit koopa_raw_integer_t" << std::endl;
-  std::cout << integer.value << std::endl;
-  return std::to_string(integer.value);
+// 整数只会作为操作数出现, 由 load_operand 和立即数形式处理, 本身不生成指令
+void Visit(const koopa_raw_integer_t &integer, RiscvContext &ctx) {
+  TRACE(ISEL, 2, "integer " << integer.value);
 }
 
-std::string get_op_value_str(const koopa_raw_value_t& value, std::vector<int>& used_ids) {
-  std::string ret;
-  if (value->kind.tag == KOOPA_RVT_BINARY) {
-      int reg_id = getRegIdx(value->kind.data.binary);
-      g_used_ids[reg_id] = 0;
-      ret = "t" + std::to_string(reg_id);
+void Visit(const koopa_raw_binary_t &binary, const koopa_raw_value_t &value, RiscvContext &ctx) {
+  TRACE(ISEL, 2, "binary op " << binary.op
+        << ", lhs tag: " << binary.lhs->kind.tag
+        << ", rhs tag: " << binary.rhs->kind.tag);
+  int dst = value_reg(value, ctx);
+  if (reduce_by_constant(binary, dst, ctx)) return;
+
+  const BinaryPattern &rr = kBinaryPatterns[binary.op];
+  int32_t imm;
+  koopa_raw_value_t reg_operand;
+  const BinaryPattern *ri = nullptr;
+  // 优先用立即数形式: 右操作数是常量, 或者左操作数是常量且交换操作数后有立即数形式
+  if (binary.rhs->kind.tag == KOOPA_RVT_INTEGER &&
+      ImmediateFor(rr, binary.rhs->kind.data.integer.value, imm)) {
+    ri = &rr;
+    reg_operand = binary.lhs;
+  } else if (binary.lhs->kind.tag == KOOPA_RVT_INTEGER && rr.swapped != kNoPattern &&
+             ImmediateFor(kBinaryPatterns[rr.swapped], binary.lhs->kind.data.integer.value, imm)) {
+    ri = &kBinaryPatterns[rr.swapped];
+    reg_operand = binary.rhs;
+  }
+
+  if (ri) {
+    int src = load_operand(reg_operand, ctx);
+    TRACE(ISEL, 3, "immediate form " << GetMachineOpInfo(ri->ri_op).name << ", imm " << imm);
+    if (imm == 0 && ri->zero_identity) {
+      // x op 0 == x, 不需要运算本身
+      if (ri->ri_post != PostOp::NONE) {
+        post_op(ri->ri_post, dst, src, ctx);
+      } else if (dst != src) {
+        ctx.Emit(MachineInst::Unary(MachineOp::MV, dst, src));
+      }
+    } else {
+      ctx.Emit(MachineInst::I(ri->ri_op, dst, src, imm));
+      post_op(ri->ri_post, dst, dst, ctx);
+    }
   } else {
-      int ret_reg_id = makeOneRegId(used_ids);
-      ret = "t" + std::to_string(ret_reg_id);
+    int lhs = load_operand(binary.lhs, ctx);
+    int rhs = load_operand(binary.rhs, ctx);
+    ctx.Emit(MachineInst::R(rr.rr_op, dst, lhs, rhs));
+    post_op(rr.rr_post, dst, dst, ctx);
   }
-  return ret;
 }
 
-std::string get_sub_exp_str(const koopa_raw_value_t& value, std::string str_reg_id) {
-  if (value->kind.tag == KOOPA_RVT_BINARY) return "";
-  std::string ret;
-  std::string str_value = std::to_string(value->kind.data.integer.value);
-  ret += "\tli  " + str_reg_id + ", " + str_value + "\n";
-  return ret;
-}
-void find_uesd_ids(const koopa_raw_binary_t& binary, std::vector<int>& used_ids) {
-    if (binary.lhs->kind.tag == KOOPA_RVT_BINARY) {
-      int reg_id = getRegIdx(binary.lhs->kind.data.binary);
-      used_ids[reg_id] = 1;
-    }
-    if (binary.rhs->kind.tag == KOOPA_RVT_BINARY) {
-      int reg_id = getRegIdx(binary.rhs->kind.data.binary);
-      used_ids[reg_id] = 1;
-    }
+// alloc 出的变量总在栈上, load/store 直接访问它的栈槽
+void Visit(const koopa_raw_load_t &load, const koopa_raw_value_t &value, RiscvContext &ctx) {
+  assert(load.src->kind.tag == KOOPA_RVT_ALLOC);
+  int dst = value_reg(value, ctx);
+  stack_load(dst, ctx.alloc_offsets.at(load.src), dst, ctx);
 }
-std::string binary_op(std::string op, const koopa_raw_binary_t& binary) {
-  std::string ret;
-  std::vector<int> used_ids(7, 0);
-  find_uesd_ids(binary, used_ids);
-  std::string str_l_reg_id = get_op_value_str(binary.lhs, used_ids);
-  ret += get_sub_exp_str(binary.lhs, str_l_reg_id);
-  std::string str_r_reg_id = get_op_value_str(binary.rhs, used_ids);
-  ret += get_sub_exp_str(binary.rhs, str_r_reg_id);
-  ret += "\t" + op +" " + str_l_reg_id + ", " + str_l_reg_id + ", " + str_r_reg_id + "\n";
-  setRegIdx(binary, stoi(str_l_reg_id.substr(1)));
-  return ret;
+
+void Visit(const koopa_raw_store_t &store, RiscvContext &ctx) {
+  assert(store.dest->kind.tag == KOOPA_RVT_ALLOC);
+  int reg = load_operand(store.value, ctx);
+  stack_store(reg, ctx.alloc_offsets.at(store.dest), ctx.mf.NewVirtualReg(), ctx);
 }
 
-std::string Visit(const koopa_raw_binary_t& binary) {
-  std::string ret;
-  std::cout << binary.op << std::endl;
-  if (binary.op == KOOPA_RBO_EQ) {
-    ret += binary_op("xor", binary);
-    std::string reg_id = makeRegString(getRegIdx(binary));
-    ret += "\tseqz " + reg_id + ", " + reg_id + "\n";
-  } else if (binary.op == KOOPA_RBO_NOT_EQ) {
-    ret += binary_op("xor", binary);
-    std::string reg_id = makeRegString(getRegIdx(binary));
-    ret += "\tsnez " + reg_id + ", " + reg_id + "\n";
-  } else if (binary.op == KOOPA_RBO_SUB) {
-    ret += binary_op("sub", binary);
-  } else if (binary.op == KOOPA_RBO_ADD) {
-    ret += binary_op("add", binary);
-  } else if (binary.op == KOOPA_RBO_MUL) {
-    ret += binary_op("mul", binary);
-  }else if (binary.op == KOOPA_RBO_DIV) {
-    ret += binary_op("div", binary);
-  }else if (binary.op == KOOPA_RBO_MOD) {
-    ret += binary_op("rem", binary);
-  } else if (binary.op == KOOPA_RBO_LT) {
-    ret += binary_op("slt", binary);
-  } else if (binary.op == KOOPA_RBO_GT) {
-    ret += binary_op("sgt", binary);
-  } else if (binary.op == KOOPA_RBO_LE) {
-    ret += binary_op("sgt", binary);
-    std::string reg_id = makeRegString(getRegIdx(binary));
-    ret += "\tseqz " + reg_id + ", " + reg_id + "\n";
-  // li    t0, 1
-  // li    t1, 2
-  // # 执行小于等于操作
-  // sgt   t1, t0, t1
-  // seqz  t1, t1
-  } else if (binary.op == KOOPA_RBO_GE) {
-    ret += binary_op("slt", binary);
-    std::string reg_id = makeRegString(getRegIdx(binary));
-    ret += "\tseqz " + reg_id + ", " + reg_id + "\n";
-  // li    t0, 1
-  // li    t1, 2
-  // # 执行小于等于操作
-  // sgt   t1, t0, t1
-  // seqz  t1, t1
-  } else if (binary.op == KOOPA_RBO_OR) {
-    ret += binary_op("or", binary);
-  } else if (binary.op == KOOPA_RBO_AND) {
-    ret += binary_op("and", binary);
-  }
-  std::cout << "endl." << std::endl;
+// br cond, true_bb, false_bb  =>  bnez cond, true_bb; j false_bb
+void Visit(const koopa_raw_branch_t &branch, RiscvContext &ctx) {
+  int cond = load_operand(branch.cond, ctx);
+  ctx.Emit(MachineInst::BranchZ(MachineOp::BNEZ, cond, branch.true_bb));
+  ctx.Emit(MachineInst::Jump(branch.false_bb));
+}
 
-  return ret;
+void Visit(const koopa_raw_jump_t &jump, RiscvContext &ctx) {
+  ctx.Emit(MachineInst::Jump(jump.target));
 }
 // 访问指令
-std::string Visit(const koopa_raw_value_t &value) {
-  std::string ret;
+void Visit(const koopa_raw_value_t &value, RiscvContext &ctx) {
   // 根据指令类型判断后续需要如何访问
   const auto &kind = value->kind;
   switch (kind.tag) {
     case KOOPA_RVT_RETURN:
       // 访问 return 指令
-      std::cout << "KOOPA_RVT_RETURN" << std::endl;
-      ret = Visit(kind.data.ret);
+      Visit(kind.data.ret, ctx);
       break;
     case KOOPA_RVT_INTEGER:
       // 访问 integer 指令
-      std::cout << "KOOPA_RVT_INTEGER" << std::endl;
-      ret = Visit(kind.data.integer);
+      Visit(kind.data.integer, ctx);
       break;
     case KOOPA_RVT_BINARY:
-      // 访问 integer 指令
-      std::cout << "KOOPA_RVT_BINARY "
-      << ", kind.op: " << kind.data.binary.op
-      << ", kind.lhs: " << kind.data.binary.lhs->kind.data.integer.value
-      << ", lhs.tag: " << kind.data.binary.lhs->kind.tag
-      << ", kind.rhs: " << kind.data.binary.rhs->kind.data.integer.value
-      << ", rhs.tag: " << kind.data.binary.rhs->kind.tag << std::endl;
-      ret = Visit(kind.data.binary);
+      // 访问 binary 指令
+      Visit(kind.data.binary, value, ctx);
+      break;
+    case KOOPA_RVT_ALLOC:
+      // 栈槽已经由 assign_alloc_slots 确定, 不生成指令
+      break;
+    case KOOPA_RVT_LOAD:
+      Visit(kind.data.load, value, ctx);
+      break;
+    case KOOPA_RVT_STORE:
+      Visit(kind.data.store, ctx);
       break;
-      
+    case KOOPA_RVT_BRANCH:
+      Visit(kind.data.branch, ctx);
+      break;
+    case KOOPA_RVT_JUMP:
+      Visit(kind.data.jump, ctx);
+      break;
+    case KOOPA_RVT_CALL:
+    case KOOPA_RVT_GLOBAL_ALLOC:
+      // 引用其他函数或全局变量: 汇编中需要 call/la, 目标文件中需要重定位 (elf_writer 还不生成),
+      // 指令选择还都不支持, 明确报错而不是生成错误的代码
+      throw std::string(ctx.options.emit_object
+                            ? "function calls and global variables need relocations, "
+                              "which -elf does not emit yet"
+                            : "function calls and global variables are not supported yet");
+
     default:
       // 其他类型暂时遇不到
-      std::cout << "untreated type: " << kind.tag << std::endl;
+      TRACE(ISEL, 1, "untreated type: " << kind.tag);
       assert(false);
   }
-  return ret;
 }
-
-static koopa_program_t program;
-static koopa_raw_program_builder_t builder;
-std::string convert_to_asm(std::string ir) {
-     // 解析字符串 str, 得到 Koopa IR 程序
-    koopa_error_code_t ret = koopa_parse_from_string(ir.c_str(), &program);
-    assert(ret == KOOPA_EC_SUCCESS);  // 确保解析时没有出错  
-    // 创建一个 raw program builder, 用来构建 raw program
-    builder = koopa_new_raw_program_builder();
-    // 将 Koopa IR 程序转换为 raw program
-    koopa_raw_program_t raw = koopa_build_raw_program(builder, program);
-    std::string ret_asm = Visit(raw);
-    std::cout << "------------------" << std::endl;
-    std::cout << ret_asm << std::endl;
-    return ret_asm;
-}
-
-void free_koopa_program() {
-    // 释放 Koopa IR 程序占用的内存
-    koopa_delete_program(program);
-    koopa_delete_raw_program_builder(builder);
-}
\ No newline at end of file
@@ -1,19 +1,63 @@
 #ifndef __VISIT_HPP__
 #define __VISIT_HPP__
 
+#include <string>
+#include <unordered_map>
+#include "elf_writer.hpp"
 #include "koopa.h"
+#include "mir.hpp"
+#include "output.hpp"
+#include "schedule.hpp"
 
-std::string Visit(const koopa_raw_slice_t &slice);
-std::string Visit(const koopa_raw_function_t &func);
-std::string Visit(const koopa_raw_basic_block_t &bb);
-std::string Visit(const koopa_raw_value_t &value);
-std::string Visit(const koopa_raw_program_t &program);
-std::string Visit(const koopa_raw_binary_t& binary);
-std::string convert_to_asm(std::string ir);
-void free_koopa_program();
-void setRegIdx(const koopa_raw_binary_t& binary, int idx);
-int getRegIdx(const koopa_raw_binary_t& binary);
-std::string get_op_value_str(const koopa_raw_value_t& value);
-std::string get_sub_exp_str(const koopa_raw_value_t& value);
+// 代码生成的选项
+struct CodegenOptions {
+  // 窥孔优化的窗口大小 (向前最多看几条指令), 0 表示不做窥孔优化
+  int peephole_window = 0;
+  // 指令调度使用的延迟模型, nullptr 表示不做调度
+  const SchedModel *sched_model = nullptr;
+  // 为 true 时输出 ELF 目标文件 (-elf), 否则输出汇编
+  bool emit_object = false;
+};
+
+// 代码生成过程中的统计
+struct CodegenStats {
+  // 窥孔优化删掉的指令数
+  size_t peephole_removed = 0;
+  // 按延迟模型估算的调度前后的周期数
+  ScheduleStats sched;
+};
+
+// 为一个程序生成汇编时的全部状态
+struct RiscvContext {
+  RiscvContext(OutputSink &out, const CodegenOptions &options) : out(out), options(options) {}
+  // 每个函数的汇编在生成完机器指令之后一次性写入 out
+  // 输出目标文件时, 每个函数编码进 object, 最后整个文件一起写入 out
+  OutputSink &out;
+  const CodegenOptions &options;
+  CodegenStats stats;
+  ElfObjectWriter object;
+  // 当前函数的机器指令
+  MachineFunction mf;
+  void Emit(const MachineInst &inst) { mf.insts.push_back(inst); }
+  // 当前函数中每个有结果的 Koopa 值对应的虚拟寄存器
+  std::unordered_map<koopa_raw_value_t, int> value_regs;
+  // 当前函数中每个 alloc 的栈槽 (相对 sp 的偏移)
+  std::unordered_map<koopa_raw_value_t, int> alloc_offsets;
+  // 当前函数的入口块, 它紧跟在函数标号之后, 不需要自己的标号
+  koopa_raw_basic_block_t entry_bb = nullptr;
+};
+
+// 入口: 为整个程序生成汇编
+CodegenStats Visit(const koopa_raw_program_t &program, OutputSink &out,
+                   const CodegenOptions &options = CodegenOptions());
+void Visit(const koopa_raw_slice_t &slice, RiscvContext &ctx);
+void Visit(const koopa_raw_function_t &func, RiscvContext &ctx);
+void Visit(const koopa_raw_basic_block_t &bb, RiscvContext &ctx);
+void Visit(const koopa_raw_value_t &value, RiscvContext &ctx);
+void Visit(const koopa_raw_binary_t &binary, const koopa_raw_value_t &value, RiscvContext &ctx);
+void Visit(const koopa_raw_load_t &load, const koopa_raw_value_t &value, RiscvContext &ctx);
+void Visit(const koopa_raw_store_t &store, RiscvContext &ctx);
+void Visit(const koopa_raw_branch_t &branch, RiscvContext &ctx);
+void Visit(const koopa_raw_jump_t &jump, RiscvContext &ctx);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+// CompileCache 的大小估计和淘汰: 用法 cache_test 临时目录
+// 目录会被清空后重新使用, 所有检查通过时返回 0
+#include <cstdio>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cache.hpp"
+
+namespace {
+
+int failures = 0;
+
+void Check(bool ok, const char *what) {
+  if (!ok) {
+    printf("FAIL cache: %s\n", what);
+    failures ++;
+  }
+}
+
+bool Exists(const std::string &dir, const std::string &key) {
+  struct stat st;
+  return stat((dir + "/" + key).c_str(), &st) == 0;
+}
+
+void RemoveDir(const std::string &dir) {
+  DIR *d = opendir(dir.c_str());
+  if (!d) return;
+  while (struct dirent *ent = readdir(d)) {
+    if (ent->d_name[0] != '.') unlink((dir + "/" + ent->d_name).c_str());
+  }
+  closedir(d);
+  rmdir(dir.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <dir>\n", argv[0]);
+    return 2;
+  }
+  std::string dir = argv[1];
+  RemoveDir(dir);
+  CompileCache cache(dir, 1000);
+  std::string error;
+  if (!cache.Init(error)) {
+    fprintf(stderr, "%s\n", error.c_str());
+    return 2;
+  }
+
+  // 第一次写入扫描一次目录; 之后反复覆盖同一个键, 总大小不变, 不需要再扫描
+  cache.Store("a", std::string(100, 'a'));
+  Check(cache.Scans() == 1, "first store scans the directory once");
+  for (int i = 0; i < 20; i ++) cache.Store("a", std::string(100, 'a'));
+  Check(cache.Scans() == 1, "overwriting the same key does not grow the estimate");
+
+  // 100 + 300 没有超过上限
+  cache.Store("b", std::string(300, 'b'));
+  Check(cache.Scans() == 1, "store below the limit does not scan");
+
+  // 100 + 300 + 700 超过上限: 扫描一次, 只淘汰最旧的 a
+  cache.Store("c", std::string(700, 'c'));
+  Check(cache.Scans() == 2, "store above the limit scans once");
+  Check(!Exists(dir, "a"), "oldest entry is evicted");
+  Check(Exists(dir, "b") && Exists(dir, "c"), "newer entries are kept");
+
+  // 扫描之后的估计值是目录的实际大小 (1000), 覆盖 c 不改变总大小
+  for (int i = 0; i < 10; i ++) cache.Store("c", std::string(700, 'c'));
+  Check(cache.Scans() == 2, "scanned total is not counted twice");
+  Check(Exists(dir, "b") && Exists(dir, "c"), "no entry is evicted at the limit");
+
+  RemoveDir(dir);
+  printf("cache: %s\n", failures ? "failed" : "ok");
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,4 @@
+// exit: 2
+int main() {
+  return 1 + 2 * 3 / 4;
+}
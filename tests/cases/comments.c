@@ -0,0 +1,13 @@
+// exit: 123
+// 块注释中的 * 和 /, 以及和行注释的嵌套, 都不能吞掉后面的 token
+int main() {
+  /* 单行 */ const int a = 1; /* 同一行上的第二个 */
+  /** 两个星号 **/ const int b = /*/ 以斜杠开头 */ 2;
+  /* 跨行的注释
+   * // 里面的行注释不起作用
+   * 和 a * b / c 这样的内容
+   */
+  const int c = 3; // 行注释里的 /* 也不起作用
+  /***/ /**/ /* ** / * */
+  return a * 100 /* 表达式中间 */ + b * 10 + c;
+}
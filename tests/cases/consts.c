@@ -0,0 +1,6 @@
+// exit: 1
+int main() {
+  const int a = 3, b = a * 2;
+  const int c = (a + b) % 4;
+  return a + b * c - (b / a) + (a < b) + (c == 1) && (b || 0);
+}
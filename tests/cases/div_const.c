@@ -0,0 +1,9 @@
+// exit: 1
+// 除以/模各种常量 (强度削减的移位和乘高位序列), 结果逐个比较后合在一起
+int main() {
+  const int x = 123456789, y = -98765;
+  return (x / 7 == 17636684) && (x % 7 == 1) && (y / 7 == -14109) && (y % 7 == -2)
+      && (x / 16 == 7716049) && (y / 16 == -6172) && (y % 16 == -13)
+      && (x / -3 == -41152263) && (y % -3 == -2) && (x / 1000 == 123456) && (y % 1000 == -765)
+      && (x * 9 == 1111111101) && (y * -5 == 493825) && (x / 2147483647 == 0);
+}
@@ -0,0 +1,10 @@
+// exit: 1
+// 除以/模 INT32_MIN (k = 31 的 2 的幂): 只有 INT32_MIN 自己的商为 1, 余数为 0
+int main() {
+  const int min = -2147483647 - 1;
+  const int x = 123456789, y = -123456789;
+  return (x / min == 0) && (y / min == 0) && (min / min == 1) && ((min + 1) / min == 0)
+      && (x % min == x) && (y % min == y) && (min % min == 0) && ((min + 1) % min == min + 1)
+      && (x % -2147483648 == x) && (min % -2147483648 == 0)
+      && (x / -2147483648 == 0) && (min / -2147483648 == 1);
+}
@@ -0,0 +1,6 @@
+// exit: -301
+// 向零取整: 负数的商和余数
+int main() {
+  const int a = -7;
+  return (a / 2) * 100 + a % 3;
+}
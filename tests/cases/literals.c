@@ -0,0 +1,9 @@
+// exit: 1
+// 十进制, 八进制和十六进制字面量; 超出 int 范围的按 32 位回绕
+int main() {
+  const int dec = 2147483647, oct = 017, hex = 0x1F, upper = 0XfF;
+  const int zeros = 0 + 00 + 0x0 + 0X00;
+  return (dec == 0x7fffffff) && (oct == 15) && (hex == 31) && (upper == 255) && (zeros == 0)
+      && (037777777777 == -1) && (0xFFFFFFFF == -1) && (4294967295 == -1)
+      && (0x80000000 == -2147483647 - 1) && (010 == 8) && (0x10 == 16) && (0xabcdef == 11259375);
+}
@@ -0,0 +1,11 @@
+// error: location.c:10:20: error: syntax error
+// 注释, 多行的块注释和制表符之后仍然报告正确的位置 (列号从 1 开始, 按字节计算)
+int main() {
+  /* 第一行
+     第二行 */
+  const int a = 0x10, b = 017;
+	/* 制表符缩进 */ const int c = a
+    /* 跨行的表达式 */
+    + b;
+  return a + b * c ) ;
+}
@@ -0,0 +1,5 @@
+// exit: 1101
+int main() {
+  const int a = 0, b = 3;
+  return (a || b && 4 || (a && 7)) + (a && (b || 1)) * 10 + ((b - 3) || (a && b) || !a) * 100 + (1 && 2 && 0 || 5 > 4) * 1000;
+}
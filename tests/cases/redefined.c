@@ -0,0 +1,6 @@
+// error: error: redefined symbol: a
+int main() {
+  const int a = 1;
+  const int a = 2;
+  return a;
+}
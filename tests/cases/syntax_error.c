@@ -0,0 +1,5 @@
+// error: syntax_error.c:4:14: error: syntax error
+// 语法错误报告出错的 token 的行号和列号
+int main() {
+  return 1 + ;
+}
@@ -0,0 +1,4 @@
+// exit: 1
+int main() {
+  return -(- + !!-+++++6);
+}
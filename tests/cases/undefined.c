@@ -0,0 +1,5 @@
+// error: error: undefined symbol: b
+int main() {
+  const int a = 1;
+  return a + b;
+}
@@ -0,0 +1,402 @@
+#!/usr/bin/env python3
+"""编译器的回归测试.
+
+tests/cases 下的每个程序用 -sim 在各组选项下运行, 与文件开头注释中的期望结果比较:
+
+    // exit: N        main 的返回值
+    // error: 信息     编译失败, 错误信息以它结尾 (单文件模式的 stderr 和 -serve 的 error 响应)
+
+另外按固定的种子随机生成表达式程序, 用 Python 按 32 位整数的语义求出期望值,
+在同样的各组选项下比较. -fno-fold 让常量运算也生成指令, 这样指令选择, 强度削减,
+寄存器分配, 窥孔优化和调度都能被这些只有常量的程序覆盖到.
+
+-serve 模式的测试在一个进程里连续编译所有用例, 结果必须和单独编译时相同.
+有 llvm-mc 时还会检查 -elf 生成的 .text 与用 llvm-mc 汇编 -riscv 的输出逐字节相同.
+用例在 -fno-fold 下的动态指令数和估算的周期数 (每个延迟模型) 与 tests/sim_golden.txt 比较.
+
+    tests/run_tests.py ... --update-sim-golden     # 确认变化无误后重新记录
+
+    tests/run_tests.py --compiler build/compiler
+    tests/run_tests.py ... --random=1000 --seed=7   # 更多的随机程序
+"""
+
+import argparse
+import os
+import random
+import re
+import shutil
+import subprocess
+import sys
+
+TESTS_DIR = os.path.dirname(os.path.abspath(__file__))
+CASES_DIR = os.path.join(TESTS_DIR, 'cases')
+
+# 每个程序都在这些选项下运行, 结果必须相同
+FLAG_SETS = [
+    [],
+    ['-O1'],
+    ['-fno-fold'],
+    ['-fno-fold', '-O1'],
+    ['-fno-fold', '-O1', '-peephole-window=0', '-sched-model=none'],
+    ['-fno-fold', '-O1', '-sched-model=rocket'],
+    ['-fno-fold', '-O1', '-sched-model=u74'],
+]
+
+DIRECTIVE_RE = re.compile(r'^//\s*([a-z-]+):\s*(.*?)\s*$', re.M)
+
+
+class Runner:
+    def __init__(self, compiler, work_dir):
+        self.compiler = compiler
+        self.work_dir = work_dir
+        self.passed = 0
+        self.failures = []
+
+    def check(self, name, ok, message=''):
+        if ok:
+            self.passed += 1
+        else:
+            self.failures.append('%s: %s' % (name, message))
+            print('FAIL %s: %s' % (name, message))
+
+    def compile(self, mode, path, flags, output=None):
+        """运行一次编译器, 返回 (是否成功, 输出文件的内容, stderr)."""
+        output = output or os.path.join(self.work_dir, 'out')
+        proc = subprocess.run([self.compiler, mode, path, '-o', output] + flags,
+                              stdout=subprocess.DEVNULL, stderr=subprocess.PIPE, text=True)
+        if proc.returncode != 0:
+            return False, None, proc.stderr.strip()
+        with open(output, 'rb') as f:
+            return True, f.read(), proc.stderr
+
+    def simulate(self, path, flags):
+        """-sim 的结果, 例如 {'exit': 0, 'instructions': 2, 'cycles': 4}, 失败时返回错误信息."""
+        ok, output, error = self.compile('-sim', path, flags)
+        if not ok:
+            return error
+        result = {}
+        for line in output.decode().splitlines():
+            key, value = line.split(':')
+            result[key.strip()] = int(value)
+        return result
+
+    def check_exit(self, name, path, expected):
+        for flags in FLAG_SETS:
+            result = self.simulate(path, flags)
+            label = '%s [%s]' % (name, ' '.join(flags))
+            if isinstance(result, str):
+                self.check(label, False, result)
+            else:
+                self.check(label, result['exit'] == expected,
+                           'exit %d, expected %d' % (result['exit'], expected))
+
+
+def read_directives(path):
+    with open(path) as f:
+        return dict(DIRECTIVE_RE.findall(f.read()))
+
+
+def run_cases(runner):
+    for name in sorted(os.listdir(CASES_DIR)):
+        if not name.endswith('.c'):
+            continue
+        path = os.path.join(CASES_DIR, name)
+        directives = read_directives(path)
+        if 'exit' in directives:
+            runner.check_exit(name, path, int(directives['exit']))
+        if 'error' in directives:
+            check_error(runner, name, path, directives['error'])
+
+
+def check_error(runner, name, path, expected):
+    ok, _, error = runner.compile('-riscv', path, [])
+    runner.check(name, not ok and error.endswith(expected), error)
+    output = serve(runner, b'-riscv %s -\n' % path.encode()).decode().rstrip('\n')
+    runner.check(name + ' [serve]', output.startswith('error ') and output.endswith(expected),
+                 output)
+
+
+def serve(runner, requests, flags=()):
+    """把 requests (bytes) 发给 -serve 进程, 返回它的输出."""
+    proc = subprocess.run([runner.compiler, '-serve'] + list(flags), input=requests,
+                          stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    return proc.stdout
+
+
+def source_request(mode, source):
+    return b'%s =%d -\n' % (mode.encode(), len(source)) + source
+
+
+def read_responses(output):
+    """把 -serve 的输出拆成 [(ok, 内容)], 内容是输出或错误信息."""
+    responses = []
+    pos = 0
+    while pos < len(output):
+        end = output.index(b'\n', pos)
+        fields = output[pos:end].split(b' ', 2)
+        pos = end + 1
+        if fields[0] == b'ok':
+            size = int(fields[2])
+            responses.append((True, output[pos:pos + size]))
+            pos += size
+        else:
+            responses.append((False, fields[2].decode()))
+    return responses
+
+
+def run_serve(runner):
+    # 声明的源程序超过上限时回复 error 而不是申请内存; 数据不完整时回复之后结束连接
+    source = b'int main() { return 3; }\n'
+    output = serve(runner, b'-koopa =%d -\n' % len(source) + source +
+                   b'-riscv =99999999999 -\nint main')
+    lines = output.split(b'\n')
+    runner.check('serve: oversized source', len(lines) >= 2 and lines[0].startswith(b'ok ') and
+                 lines[-2].startswith(b'error ') and b'source too large' in lines[-2],
+                 repr(output))
+
+    # 同一个进程 (同一个 CompileContext) 连续处理不同的程序, 结果必须和单独编译时相同:
+    # 前一个程序的符号, Arena 中的节点和表达式的折叠结果都不能留到后一个程序
+    # 前两个程序的表达式节点编号相同, 第三个程序用到前面定义过的名字, 必须报错
+    sources = [b'int main() { const int x = 6; return x * 7; }\n',
+               b'int main() { const int x = 2; return x * 5; }\n',
+               b'int main() { return x; }\n']
+    sources += [open(os.path.join(CASES_DIR, name), 'rb').read()
+                for name in sorted(os.listdir(CASES_DIR)) if name.endswith('.c')]
+    for flags in ([], ['-fno-fold', '-O1']):
+        for mode in ('-koopa', '-sim'):
+            expected = []
+            for i, source in enumerate(sources):
+                path = os.path.join(runner.work_dir, 'serve%d.c' % i)
+                with open(path, 'wb') as f:
+                    f.write(source)
+                ok, output, error = runner.compile(mode, path, flags)
+                expected.append((True, output) if ok else (False, error.split(': ', 1)[1]))
+            requests = b''.join(source_request(mode, source) for source in sources)
+            responses = read_responses(serve(runner, requests, flags))
+            label = 'serve: back to back %s [%s]' % (mode, ' '.join(flags))
+            runner.check(label, len(responses) == len(sources),
+                         '%d responses for %d requests' % (len(responses), len(sources)))
+            for i, (response, reference) in enumerate(zip(responses, expected)):
+                # 错误信息中的文件名不同, 只比较之后的部分
+                if not response[0]:
+                    response = (False, response[1].split(': ', 1)[1])
+                runner.check('%s #%d' % (label, i), response == reference,
+                             '%r, expected %r' % (response, reference))
+    responses = read_responses(serve(runner, b''.join(source_request('-sim', source)
+                                                      for source in sources[:3])))
+    runner.check('serve: no leaked symbols', [r[0] for r in responses] == [True, True, False] and
+                 b'exit: 42' in responses[0][1] and b'exit: 10' in responses[1][1] and
+                 'undefined symbol: x' in responses[2][1], repr(responses))
+
+
+def text_section(path):
+    """用 llvm-objcopy 取出目标文件中 .text 的内容."""
+    binary = path + '.text'
+    subprocess.run(['llvm-objcopy', '-O', 'binary', '--only-section=.text', path, binary],
+                   check=True)
+    with open(binary, 'rb') as f:
+        return f.read()
+
+
+def run_elf(runner):
+    # -elf 的 .text 必须和用 llvm-mc 汇编 -riscv 的输出得到的逐字节相同
+    if not shutil.which('llvm-mc') or not shutil.which('llvm-objcopy'):
+        print('skip -elf tests: llvm-mc or llvm-objcopy not found')
+        return
+    for name in sorted(os.listdir(CASES_DIR)):
+        path = os.path.join(CASES_DIR, name)
+        if not name.endswith('.c') or 'exit' not in read_directives(path):
+            continue
+        for flags in FLAG_SETS:
+            label = '%s -elf [%s]' % (name, ' '.join(flags))
+            asm = os.path.join(runner.work_dir, 'elf.S')
+            obj = os.path.join(runner.work_dir, 'elf.o')
+            ref = os.path.join(runner.work_dir, 'elf.ref.o')
+            ok_asm, _, error = runner.compile('-riscv', path, flags, asm)
+            ok_obj, _, error_obj = runner.compile('-elf', path, flags, obj)
+            if not ok_asm or not ok_obj:
+                runner.check(label, False, error or error_obj)
+                continue
+            proc = subprocess.run(['llvm-mc', '-triple=riscv32', '-mattr=+m', '-filetype=obj',
+                                   asm, '-o', ref], stderr=subprocess.PIPE, text=True)
+            if proc.returncode != 0:
+                runner.check(label, False, 'llvm-mc: ' + proc.stderr.strip())
+                continue
+            runner.check(label, text_section(obj) == text_section(ref),
+                         '.text differs from llvm-mc')
+
+
+SIM_GOLDEN = os.path.join(TESTS_DIR, 'sim_golden.txt')
+SIM_FLAG_SETS = [flags + ['-sim-model=' + model]
+                 for flags in (['-fno-fold'], ['-fno-fold', '-O1'])
+                 for model in ('generic', 'rocket', 'u74')]
+
+
+def run_sim(runner, update):
+    # 没有折叠的代码在模拟器上的动态指令数和周期数与记录的结果比较,
+    # 代码生成或模拟器的改动使它们变化时, 确认无误后用 --update-sim-golden 重新记录
+    results = {}
+    for name in sorted(os.listdir(CASES_DIR)):
+        path = os.path.join(CASES_DIR, name)
+        if not name.endswith('.c') or 'exit' not in read_directives(path):
+            continue
+        for flags in SIM_FLAG_SETS:
+            key = '%s %s' % (name, ' '.join(flags))
+            result = runner.simulate(path, flags)
+            if isinstance(result, str):
+                runner.check('sim: ' + key, False, result)
+                continue
+            results[key] = '%d %d %d' % (result['exit'], result['instructions'], result['cycles'])
+            # 单发射, 每条指令至少一个周期
+            runner.check('sim: %s cycles' % key, result['cycles'] >= result['instructions'],
+                         results[key])
+    if update:
+        with open(SIM_GOLDEN, 'w') as f:
+            f.write('# 用例 选项: 返回值 指令数 周期数, 由 tests/run_tests.py --update-sim-golden 生成\n')
+            for key in sorted(results):
+                f.write('%s: %s\n' % (key, results[key]))
+        print('sim results written to %s' % SIM_GOLDEN)
+        return
+    golden = {}
+    with open(SIM_GOLDEN) as f:
+        for line in f:
+            if line.strip() and not line.startswith('#'):
+                key, value = line.rsplit(':', 1)
+                golden[key] = value.strip()
+    for key in sorted(set(results) | set(golden)):
+        runner.check('sim: ' + key, results.get(key) == golden.get(key),
+                     '%s, expected %s' % (results.get(key), golden.get(key)))
+
+
+# 随机表达式程序
+
+def s32(x):
+    x &= 0xffffffff
+    return x - (1 << 32) if x & 0x80000000 else x
+
+
+def c_div(l, r):
+    # 向零取整, INT_MIN / -1 按 RISC-V 的语义回绕
+    q = abs(l) // abs(r)
+    return s32(q if (l < 0) == (r < 0) else -q)
+
+
+BINARY_OPS = {
+    '+': lambda l, r: s32(l + r),
+    '-': lambda l, r: s32(l - r),
+    '*': lambda l, r: s32(l * r),
+    '/': c_div,
+    '%': lambda l, r: s32(l - c_div(l, r) * r),
+    '<': lambda l, r: int(l < r),
+    '>': lambda l, r: int(l > r),
+    '<=': lambda l, r: int(l <= r),
+    '>=': lambda l, r: int(l >= r),
+    '==': lambda l, r: int(l == r),
+    '!=': lambda l, r: int(l != r),
+    '&&': lambda l, r: int(l != 0 and r != 0),
+    '||': lambda l, r: int(l != 0 or r != 0),
+}
+# 覆盖强度削减的各种情况: 2 的幂, 2^k ± 1, 12 位立即数的边界, 大常量
+INTERESTING = [0, 1, 2, 3, 5, 7, 8, 9, 10, 15, 16, 17, 31, 100, 641, 2047, 2048, 4095, 4096,
+               65536, 65537, 12345678, 1 << 30, 2147483647]
+
+
+class DivideByZero(Exception):
+    pass
+
+
+class ExprGenerator:
+    def __init__(self, rng):
+        self.rng = rng
+        self.names = {}
+
+    def literal(self):
+        value = self.rng.choice(INTERESTING) if self.rng.random() < 0.7 else \
+            self.rng.randrange(0, 1 << 31)
+        text = self.rng.choice(['%d', '0x%x', '0%o']) % value if value else '0'
+        return text, value
+
+    def leaf(self):
+        if self.names and self.rng.random() < 0.4:
+            name = self.rng.choice(sorted(self.names))
+            return name, self.names[name]
+        return self.literal()
+
+    def expr(self, depth):
+        """返回 (源代码, 值), 除数为 0 时抛出 DivideByZero."""
+        r = self.rng.random()
+        if depth == 0 or r < 0.15:
+            return self.leaf()
+        if r < 0.3:
+            op = self.rng.choice(['-', '!', '+'])
+            text, value = self.expr(depth - 1)
+            value = {'-': s32(-value), '!': int(value == 0), '+': value}[op]
+            return '%s(%s)' % (op, text), value
+        op = self.rng.choice(sorted(BINARY_OPS))
+        lhs, lvalue = self.expr(depth - 1)
+        # 除法的右边多用常量, 这样强度削减也能覆盖到
+        if op in '/%' and self.rng.random() < 0.6:
+            rhs, rvalue = self.literal()
+            if self.rng.random() < 0.3:
+                rhs, rvalue = '-' + rhs, s32(-rvalue)
+        else:
+            rhs, rvalue = self.expr(depth - 1)
+        if op in '/%' and rvalue == 0:
+            raise DivideByZero()
+        return '(%s %s %s)' % (lhs, op, rhs), BINARY_OPS[op](lvalue, rvalue)
+
+    def program(self):
+        lines = ['int main() {']
+        for i in range(self.rng.randrange(0, 4)):
+            text, value = self.expr(3)
+            name = 'c%d' % i
+            lines.append('  const int %s = %s;' % (name, text))
+            self.names[name] = value
+        text, value = self.expr(5)
+        lines.append('  return %s;' % text)
+        lines.append('}')
+        return '\n'.join(lines) + '\n', value
+
+
+def run_random(runner, count, seed):
+    rng = random.Random(seed)
+    done = 0
+    while done < count:
+        try:
+            source, expected = ExprGenerator(rng).program()
+        except DivideByZero:
+            continue
+        path = os.path.join(runner.work_dir, 'random%d.c' % done)
+        with open(path, 'w') as f:
+            f.write(source)
+        failed = len(runner.failures)
+        runner.check_exit('random%d' % done, path, expected)
+        if len(runner.failures) == failed:
+            os.remove(path)
+        done += 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--compiler', default='build/compiler')
+    parser.add_argument('--work', default='build/tests', help='存放中间文件的目录')
+    parser.add_argument('--random', type=int, default=200, help='随机程序的个数')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--update-sim-golden', action='store_true',
+                        help='把本次模拟的指令数和周期数记录到 tests/sim_golden.txt')
+    args = parser.parse_args()
+    os.makedirs(args.work, exist_ok=True)
+
+    runner = Runner(os.path.abspath(args.compiler), args.work)
+    run_cases(runner)
+    run_serve(runner)
+    run_elf(runner)
+    run_sim(runner, args.update_sim_golden)
+    run_random(runner, args.random, args.seed)
+    print('%d passed, %d failed' % (runner.passed, len(runner.failures)))
+    return 1 if runner.failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())